@@ -1,9 +1,58 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <array>
+#include <bit>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
 #include <boost/asio.hpp>
 #include <ranges>
 #include <list>
+#include <algorithm>
+#include <span>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <system_error>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#define STREAMBUF_HAS_EVENTFD
+#endif
+#if defined(__has_include)
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#define STREAMBUF_HAS_UNISTD
+#endif
+#endif
+
+// USDT probes for `perf` and `bpftrace`, which cost a `nop` until they are attached.
+// They are compiled in when `<sys/sdt.h>` is available, unless `STREAMBUF_DISABLE_PROBES` is defined.
+#if !defined(STREAMBUF_DISABLE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define STREAMBUF_PROBE(name, ...) STAP_PROBEV(streambuf, name, __VA_ARGS__)
+#endif
+#endif
+#if !defined(STREAMBUF_PROBE)
+#define STREAMBUF_PROBE(name, ...) ((void)0)
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define STREAMBUF_HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define STREAMBUF_HAS_RDTSC
+#endif
+#if !defined(STREAMBUF_TRACE_CAPACITY)
+#define STREAMBUF_TRACE_CAPACITY 4096
+#endif
 
 using namespace std::chrono_literals;
 
@@ -28,6 +77,333 @@ public:
     def crend(this auto &&self) noexcept requires std::ranges::bidirectional_range<D> { return std::make_reverse_iterator(self.derived().cend()); }
 };
 
+/**
+ * @brief A storage that leaves its elements unconstructed.
+ * @note `StreamBuffer` constructs elements when they are emplaced into a `write_view`
+ *       and destroys them when the `read_view` that consumed them is returned.
+ *       Copying or moving the storage itself does not touch the elements.
+ * @tparam T the element type, which does not need to be default-constructible
+ * @tparam N the number of elements
+ */
+template<typename T, size_t N>
+class uninitialized_storage {
+    alignas(T) std::byte bytes[N * sizeof(T)];
+public:
+    static constexpr bool is_uninitialized = true;
+    uninitialized_storage() noexcept { }
+    uninitialized_storage(const uninitialized_storage &) noexcept { }
+    uninitialized_storage &operator=(const uninitialized_storage &) noexcept { return *this; }
+    T *data() noexcept { return reinterpret_cast<T *>(bytes); }
+    const T *data() const noexcept { return reinterpret_cast<const T *>(bytes); }
+    T *begin() noexcept { return data(); }
+    const T *begin() const noexcept { return data(); }
+    T *end() noexcept { return data() + N; }
+    const T *end() const noexcept { return data() + N; }
+    constexpr size_t size() const noexcept { return N; }
+    T &operator[](size_t index) noexcept { return data()[index]; }
+    const T &operator[](size_t index) const noexcept { return data()[index]; }
+};
+
+/**
+ * @brief A storage aligned for direct I/O.
+ * @note `O_DIRECT` requires the address, the size and the file offset of each transfer
+ *       to be multiples of the logical block size, see `StreamBuffer::prepare_aligned()`.
+ * @tparam T the element type
+ * @tparam N the number of elements
+ * @tparam Align the alignment in bytes
+ */
+template<typename T, size_t N, size_t Align = 4096>
+class aligned_storage {
+    static_assert(Align >= alignof(T) && (Align & (Align - 1)) == 0, "aligned_storage alignment must be a power of two");
+    alignas(Align) T elements[N] {};
+public:
+    T *data() noexcept { return elements; }
+    const T *data() const noexcept { return elements; }
+    T *begin() noexcept { return elements; }
+    const T *begin() const noexcept { return elements; }
+    T *end() noexcept { return elements + N; }
+    const T *end() const noexcept { return elements + N; }
+    constexpr size_t size() const noexcept { return N; }
+    T &operator[](size_t index) noexcept { return elements[index]; }
+    const T &operator[](size_t index) const noexcept { return elements[index]; }
+};
+
+/**
+ * @brief A counter that can be read from any thread while it is updated.
+ * @note Counting is compiled out unless `STREAMBUF_ENABLE_STATS` is defined.
+ */
+struct stat_counter {
+#if defined(STREAMBUF_ENABLE_STATS)
+    std::atomic<std::uint64_t> value = 0;
+    void add(std::uint64_t n = 1) noexcept { value.fetch_add(n, std::memory_order_relaxed); }
+    void max(std::uint64_t n) noexcept {
+        for (auto current = value.load(std::memory_order_relaxed); n > current && !value.compare_exchange_weak(current, n, std::memory_order_relaxed);) { }
+    }
+    std::uint64_t load() const noexcept { return value.load(std::memory_order_relaxed); }
+#else
+    void add(std::uint64_t = 1) noexcept { }
+    void max(std::uint64_t) noexcept { }
+    std::uint64_t load() const noexcept { return 0; }
+#endif
+};
+
+/**
+ * @brief A cheap clock for the statistics and the traces: the TSC on x86, `steady_clock` elsewhere.
+ */
+struct stat_clock {
+    /**
+     * @brief Get the current time in ticks
+     */
+    static std::uint64_t now() noexcept {
+#if defined(STREAMBUF_HAS_RDTSC)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /**
+     * @brief Get the number of nanoseconds per tick, measured against `steady_clock` since the program started
+     */
+    static double ns_per_tick() noexcept {
+#if defined(STREAMBUF_HAS_RDTSC)
+        std::uint64_t ticks = now() - origin.ticks;
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - origin.time).count();
+        return ticks != 0 ? elapsed / ticks : 1.0;
+#else
+        return 1.0;
+#endif
+    }
+
+private:
+#if defined(STREAMBUF_HAS_RDTSC)
+    struct reference {
+        std::uint64_t ticks;
+        std::chrono::steady_clock::time_point time;
+    };
+    static inline const reference origin { now(), std::chrono::steady_clock::now() };
+#endif
+};
+
+/**
+ * @brief A stopwatch started at construction, compiled out unless `STREAMBUF_ENABLE_STATS` is defined.
+ */
+struct stat_timer {
+#if defined(STREAMBUF_ENABLE_STATS)
+    std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now();
+    std::uint64_t elapsed() const noexcept { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count(); }
+#else
+    std::uint64_t elapsed() const noexcept { return 0; }
+#endif
+};
+
+/**
+ * @brief A histogram of durations in nanoseconds, compiled out unless `STREAMBUF_ENABLE_STATS` is defined.
+ * @note Each power of two is split in 4 linear buckets, so a value is located within 25% with a fixed
+ *       number of buckets, as in an HDR histogram. Recording is a single relaxed increment.
+ */
+struct stat_histogram {
+    static constexpr size_t bucket_count = 252;
+
+    /**
+     * @brief Get the bucket of a value
+     */
+    static constexpr size_t bucket(std::uint64_t value) noexcept {
+        if (value < 4)
+            return value;
+        size_t exponent = std::bit_width(value) - 1;
+        return 4 * (exponent - 1) + ((value >> (exponent - 2)) & 3);
+    }
+
+    /**
+     * @brief Get the smallest value of a bucket
+     */
+    static constexpr std::uint64_t lower_bound(size_t bucket) noexcept { return bucket < 4 ? bucket : std::uint64_t(4 + bucket % 4) << (bucket / 4 - 1); }
+
+    /**
+     * @brief The counts of a histogram at some instant
+     */
+    struct counts {
+        std::array<std::uint64_t, bucket_count> buckets {};
+
+        /**
+         * @brief Get the number of recorded values
+         */
+        std::uint64_t total() const noexcept { return std::ranges::fold_left(buckets, std::uint64_t(0), std::plus<>()); }
+
+        /**
+         * @brief Get the smallest value of the bucket that holds the quantile `q`
+         * @param q the quantile in [0, 1], such as 0.99
+         * @return the smallest value of the bucket, or 0 if no value was recorded
+         */
+        std::uint64_t quantile(double q) const noexcept {
+            auto count = total();
+            if (count == 0)
+                return 0;
+            auto rank = std::min(static_cast<std::uint64_t>(q * count), count - 1);
+            for (size_t i = 0; i < bucket_count; ++i)
+                if (buckets[i] > rank)
+                    return lower_bound(i);
+                else
+                    rank -= buckets[i];
+            return 0;
+        }
+
+        /**
+         * @brief Convert the values to another unit
+         * @param factor the size of the old unit in the new one, such as `stat_clock::ns_per_tick()`
+         * @note Each bucket moves to the bucket of its smallest value, so the precision stays within 25%.
+         */
+        counts scaled(double factor) const noexcept {
+            counts result;
+            for (size_t i = 0; i < bucket_count; ++i)
+                if (buckets[i] != 0)
+                    result.buckets[bucket(static_cast<std::uint64_t>(std::min(lower_bound(i) * factor, 1.8e19)))] += buckets[i];
+            return result;
+        }
+    };
+
+#if defined(STREAMBUF_ENABLE_STATS)
+    std::array<std::atomic<std::uint64_t>, bucket_count> buckets {};
+    void record(std::uint64_t value) noexcept { buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed); }
+    counts load() const noexcept {
+        counts result;
+        for (size_t i = 0; i < bucket_count; ++i)
+            result.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        return result;
+    }
+#else
+    void record(std::uint64_t) noexcept { }
+    counts load() const noexcept { return {}; }
+#endif
+};
+
+/**
+ * @brief The kind of an operation recorded by a `flight_recorder`
+ */
+enum class trace_op : std::uint8_t { prepare, commit, read, consume, fail, drop, wait, wake };
+
+/**
+ * @brief An operation recorded by a `flight_recorder`
+ */
+struct trace_event {
+    std::uint64_t timestamp;    // the ticks of `stat_clock`, TSC ticks on x86
+    std::uint64_t position;     // the position in the storage
+    std::uint64_t size;         // the size of the view, or for `wait` and `wake` the committed size in the upper 32 bits and the space in the lower
+    std::uint32_t thread;       // the thread id
+    trace_op op;
+};
+
+/**
+ * @brief A lock-free ring of the last `C` operations on a buffer, see `StreamBuffer::trace()`.
+ * @note Recording is a relaxed `fetch_add` and a few relaxed stores. Each slot carries a sequence
+ *       number, so a reader skips the slots being overwritten instead of stopping the writers.
+ *       Recording is compiled out unless `STREAMBUF_ENABLE_TRACE` is defined.
+ * @tparam C the number of operations kept
+ */
+template<size_t C>
+class flight_recorder {
+#if defined(STREAMBUF_ENABLE_TRACE)
+    struct slot {
+        std::atomic<std::uint64_t> sequence = 0;    // 2 * index + 2 when written, odd while being written
+        std::atomic<std::uint64_t> timestamp = 0, position = 0, size = 0, thread_op = 0;
+    };
+    std::atomic<std::uint64_t> head = 0;
+    std::array<slot, C> slots {};
+
+    static std::uint32_t thread_id() noexcept {
+#if defined(__linux__)
+        static thread_local const std::uint32_t id = gettid();
+#else
+        static thread_local const std::uint32_t id = std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+        return id;
+    }
+
+    /**
+     * @brief Read a slot, or nothing if it does not hold the operation `index` anymore
+     */
+    std::optional<trace_event> load(std::uint64_t index) const noexcept {
+        const slot &s = slots[index % C];
+        if (s.sequence.load(std::memory_order_acquire) != 2 * index + 2)
+            return std::nullopt;
+        std::uint64_t thread_op = s.thread_op.load(std::memory_order_relaxed);
+        trace_event event {
+            s.timestamp.load(std::memory_order_relaxed), s.position.load(std::memory_order_relaxed), s.size.load(std::memory_order_relaxed),
+            static_cast<std::uint32_t>(thread_op >> 8), static_cast<trace_op>(thread_op & 0xFF),
+        };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.sequence.load(std::memory_order_relaxed) != 2 * index + 2)
+            return std::nullopt;
+        return event;
+    }
+
+public:
+    void record(trace_op op, std::uint64_t position, std::uint64_t size) noexcept {
+        std::uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+        slot &s = slots[index % C];
+        s.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.timestamp.store(stat_clock::now(), std::memory_order_relaxed);
+        s.position.store(position, std::memory_order_relaxed);
+        s.size.store(size, std::memory_order_relaxed);
+        s.thread_op.store(std::uint64_t(thread_id()) << 8 | static_cast<std::uint8_t>(op), std::memory_order_relaxed);
+        s.sequence.store(2 * index + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Call `f` with each recorded operation, from the oldest
+     * @note No memory is allocated, so this can be used in a signal handler.
+     */
+    void for_each(auto &&f) const noexcept {
+        std::uint64_t last = head.load(std::memory_order_acquire);
+        for (std::uint64_t index = last > C ? last - C : 0; index < last; ++index)
+            if (auto event = load(index))
+                f(*event);
+    }
+#else
+public:
+    void record(trace_op, std::uint64_t, std::uint64_t) noexcept { }
+    void for_each(auto &&) const noexcept { }
+#endif
+};
+
+/**
+ * @brief A view that has been lent and not yet returned, see `StreamBuffer::oldest_read_view()`.
+ */
+struct outstanding_view {
+    size_t position;        // the beginning of the view in the storage
+    std::uint64_t age_ns;   // the time since the view was lent, 0 unless `STREAMBUF_ENABLE_STATS` is defined
+};
+
+/**
+ * @brief A snapshot of the counters of a `StreamBuffer`, see `StreamBuffer::stats()`.
+ * @note Every field is 0 unless `STREAMBUF_ENABLE_STATS` is defined.
+ */
+struct buffer_stats {
+    struct manager {
+        std::uint64_t lends = 0;        // the number of views lent
+        std::uint64_t returns = 0;      // the number of views returned
+        std::uint64_t failures = 0;     // the number of lends that failed for lack of space or data
+        std::uint64_t elements = 0;     // the number of elements committed or consumed
+        std::uint64_t waits = 0;        // the number of asynchronous waits for space or data
+        std::uint64_t wakeups = 0;      // the number of asynchronous waits that resumed
+        std::uint64_t lock_hold_ns = 0; // the total time the mutex was held
+        std::uint64_t acquisitions = 0; // the number of times the mutex was locked
+        std::uint64_t contended = 0;    // the number of times the mutex was locked after waiting for another thread
+        std::uint64_t lock_wait_ns = 0; // the total time spent waiting for the mutex
+        stat_histogram::counts lock_wait {}; // the time each contended acquisition waited
+        stat_histogram::counts lock_hold {}; // the time each acquisition held the mutex
+        stat_histogram::counts view_hold {}; // the time from lending each view to returning it
+    };
+    manager write;                  // `prepare()` and the asynchronous waits for space
+    manager read;                   // `read()` and the asynchronous waits for data
+    std::uint64_t bytes_committed = 0;
+    std::uint64_t bytes_consumed = 0;
+    std::uint64_t high_water = 0;   // the largest committed size seen
+    stat_histogram::counts queue_latency {}; // the nanoseconds from committing each batch to consuming it
+};
+
 
 template<typename T, size_t N = 0, class S = std::array<T, N>>
 class StreamBuffer : public view_interface<StreamBuffer<T, N, S>> {
@@ -38,6 +414,12 @@ class StreamBuffer : public view_interface<StreamBuffer<T, N, S>> {
 
     static def get_distance(size_t start, size_t end) noexcept { return end >= start ? end - start : N - (start - end); }
 
+    // Whether the buffer constructs and destroys the elements itself, see `uninitialized_storage`.
+    static constexpr bool manages_lifetime = requires { requires S::is_uninitialized; };
+
+    // Whether the storage keeps the committed and consumed positions across restarts, see `mapped_storage`.
+    static constexpr bool persists_positions = requires { requires S::is_persistent; };
+
     template<class V>
         requires std::is_same_v<std::remove_const_t<V>, T>
     struct normal_iterator {
@@ -67,26 +449,83 @@ class StreamBuffer : public view_interface<StreamBuffer<T, N, S>> {
 
     S storage;
     size_t before_start = 0;   // the start of the read memory, the end of unuse memory
+    size_t writable_end = 0;   // the oldest position still needed by `read()` or any subscriber
     size_t start = 0;          // the start of the owned memory, the end of the read memory
     size_t stop = 0;           // the end of the owned memory, the start of the prepared memory
     size_t after_stop = 0;     // the end of the prepared memory, the start of the unuse memory
 
+    std::atomic<std::uint64_t> dropped = 0;  // the number of elements dropped by `prepare_overwrite()` and not yet reported
+    std::atomic<size_t> aligned_padding = N; // the beginning of the padding skipped by `prepare_aligned()` at the wrap point, or N
+    [[no_unique_address]] stat_counter high_water; // the largest committed size seen, see `stats()`
+    [[no_unique_address]] flight_recorder<STREAMBUF_TRACE_CAPACITY> recorder; // the last operations, see `trace()`
+
     /**
      * @brief A manager to manage the collection of lent views.
      * @note The manager can lend views for reading or writing efficiently,
      *       and will keep track of the lent views and the available space or data.
      * @tparam R the number of elements to reserve. Due to the circular nature of the buffer, 
      *         One element should be reserved when two indices go across the end of the buffer.
+     * @tparam Consuming whether returning a view consumes its elements
      */
-    template<size_t R>
+    template<size_t R, bool Consuming>
     struct Manager {
         StreamBuffer<T, N, S> &buffer;
         size_t &lent_begin;         // The beginning of the oldest lent view, may be increased when returning.
         size_t &lendable_begin;     // The beginning of the lendable space, may be increased when lending.
         const size_t &lendable_end; // The end of lendable space, read only.
-        std::list<size_t> nodes {}; // the nodes of the lent views
+        void (StreamBuffer::*returned)() = nullptr; // Called under the lock after `lent_begin` is increased.
+        static constexpr bool reading = R == 0; // `read()` and the subscribers reserve nothing, `prepare()` reserves one element
+
+        struct node {
+            size_t begin;                           // the beginning of the lent view
+            [[no_unique_address]] stat_timer lent;  // started when the view was lent
+        };
+        std::list<node> nodes {};   // the nodes of the lent views, from the oldest
         std::mutex mutex {};        // the mutex to protect the nodes
 
+        [[no_unique_address]] struct {
+            [[no_unique_address]] stat_counter lends, returns, failures, elements, hold_ns;
+            [[no_unique_address]] stat_counter acquisitions, contended, wait_ns;
+            [[no_unique_address]] stat_histogram wait_times, hold_times, view_times;
+        } counters {};
+
+        /**
+         * @brief Lock the mutex, recording whether another thread held it and how long it took
+         */
+        std::unique_lock<std::mutex> acquire() {
+#if defined(STREAMBUF_ENABLE_STATS)
+            std::unique_lock lock(mutex, std::try_to_lock);
+            counters.acquisitions.add();
+            if (!lock.owns_lock()) {
+                stat_timer waited;
+                lock.lock();
+                std::uint64_t elapsed = waited.elapsed();
+                counters.contended.add();
+                counters.wait_ns.add(elapsed);
+                counters.wait_times.record(elapsed);
+            }
+            return lock;
+#else
+            return std::unique_lock(mutex);
+#endif
+        }
+
+        /**
+         * @brief A lock of the manager that records how long it is held
+         */
+        struct guard {
+            Manager &manager;
+            std::unique_lock<std::mutex> lock;
+            stat_timer held {};
+            explicit guard(Manager &manager) : manager { manager }, lock { manager.acquire() } { }
+            guard(const guard &) = delete;
+            ~guard() {
+                std::uint64_t elapsed = held.elapsed();
+                manager.counters.hold_ns.add(elapsed);
+                manager.counters.hold_times.record(elapsed);
+            }
+        };
+
         /**
          * @brief A view that owns a part of the buffer.
          * @note The view will automatically return its memory to the manager at destruction.
@@ -98,58 +537,180 @@ class StreamBuffer : public view_interface<StreamBuffer<T, N, S>> {
             def end() const noexcept -> normal_iterator<T> {
                 return {manager->buffer.storage.data(), start, stop};
             }
+
+            /**
+             * @brief Get the elements as contiguous parts
+             * @return the part before the end of the storage and the part after it, which may be empty
+             */
+            def segments() const noexcept { return split(manager->buffer.storage.data(), start, stop); }
             owning_view() = delete;
             owning_view(const owning_view &) = delete;
             owning_view(owning_view &&other) {
-                std::lock_guard lock(other.manager->mutex);
+                guard lock { *other.manager };
                 swap(other);
             }
             owning_view &operator=(const owning_view &) = delete;
+
+            /**
+             * @brief Construct an element in place
+             * @param index the index in the view
+             * @return the constructed element as `T &`
+             * @note With `uninitialized_storage` the elements are emplaced in order, and only the emplaced
+             *       prefix is committed, which is possible because only one write view is lent at a time.
+             * @throw std::out_of_range with `uninitialized_storage` if an earlier element was not emplaced
+             */
+            def &emplace(size_t index, auto &&...args) const requires (!reading) {
+                T *element = &begin()[index];
+                if constexpr (manages_lifetime) {
+                    if (index > constructed)
+                        throw std::out_of_range("elements must be emplaced in order");
+                    if (index < constructed)
+                        return *element = T(std::forward<decltype(args)>(args)...);
+                    std::construct_at(element, std::forward<decltype(args)>(args)...);
+                    ++constructed;
+                    return *element;
+                } else
+                    return *element = T(std::forward<decltype(args)>(args)...);
+            }
+
+            /**
+             * @brief Give back the tail of the view, such as the part a read from a file did not fill
+             * @param n the new size
+             * @throw std::out_of_range if `n` is larger than the size
+             * @throw std::logic_error if a later view has been lent
+             * @note Only write views can shrink, a read or subscriber view would un-read its tail, see `give_back()`.
+             */
+            void shrink(size_t n) requires (!reading) {
+                if (n > this->size())
+                    throw std::out_of_range("shrink size too large");
+                if (n == this->size())
+                    return;
+                guard lock { *manager };
+                if (manager->lendable_begin != stop)
+                    throw std::logic_error("only the last lent view can shrink");
+                if constexpr (manages_lifetime)
+                    if (n < constructed) {
+                        std::destroy(begin() + n, begin() + constructed);
+                        constructed = n;
+                    }
+                stop = (start + n) % N;
+                manager->lendable_begin = stop;
+            }
+
+            /**
+             * @brief Return the view without consuming its elements, such as after a failed write to a file
+             * @note The view becomes empty, and the elements are read again by the next view.
+             * @throw std::logic_error if a later view has been lent
+             */
+            void give_back() requires Consuming {
+                if (this->empty())
+                    return;
+                guard lock { *manager };
+                if (manager->lendable_begin != stop)
+                    throw std::logic_error("only the last lent view can be given back");
+                manager->lendable_begin = stop = start;
+            }
+
+            /**
+             * @brief Get a range that moves the elements out of the view
+             * @return a range of `T &&`
+             */
+            def take() const noexcept requires Consuming {
+                return std::ranges::subrange(std::make_move_iterator(begin()), std::make_move_iterator(end()));
+            }
+
+            /**
+             * @brief Move all elements out of the view
+             * @param out the output iterator
+             * @return the output iterator past the last moved element
+             */
+            def drain_into(std::weakly_incrementable auto out) const requires Consuming {
+                return std::ranges::move(begin(), end(), std::move(out)).out;
+            }
             owning_view &operator=(owning_view &&other) {
-                std::scoped_lock lock(manager->mutex, other.manager->mutex);
+                // lock in the order of the addresses, and only once if both views come from the same manager
+                Manager *first = std::min(manager, other.manager, std::less<>()), *second = std::max(manager, other.manager, std::less<>());
+                std::optional<guard> first_lock, second_lock;
+                if (first != nullptr)
+                    first_lock.emplace(*first);
+                if (second != first)
+                    second_lock.emplace(*second);
                 swap(other);
                 return *this;
             }
             ~owning_view() {
                 if (manager == nullptr) return;
-                std::lock_guard lock(manager->mutex);
+                if constexpr (Consuming && manages_lifetime)
+                    std::destroy(begin(), end());
+                guard lock { *manager };
+                if constexpr (!reading && manages_lifetime)
+                    // commit only the emplaced prefix, so that the reader never destroys a dead element,
+                    // this view is the last one since no other write view can be lent meanwhile
+                    manager->lendable_begin = stop = (start + constructed) % N;
+                manager->counters.returns.add();
+                manager->counters.elements.add(get_distance(start, stop));
+                manager->counters.view_times.record(it->lent.elapsed());
+                STREAMBUF_PROBE(release, &manager->buffer, int(Consuming), start, get_distance(start, stop));
+                manager->buffer.recorder.record(reading ? trace_op::consume : trace_op::commit, start, get_distance(start, stop));
                 it = manager->nodes.erase(it);
-                if (it == manager->nodes.begin())
-                    manager->lent_begin = (it == manager->nodes.end()) ? manager->lendable_begin : *it;
+                if (it == manager->nodes.begin()) {
+                    manager->lent_begin = (it == manager->nodes.end()) ? manager->lendable_begin : it->begin;
+                    if (manager->returned != nullptr)
+                        (manager->buffer.*manager->returned)();
+                }
             }
         private:
             friend class Manager;
-            owning_view(Manager *manager, size_t n) : manager { manager } {
-                std::lock_guard lock(manager->mutex);
+            /**
+             * @param measure called as `measure(lendable_begin, available_size)` under the lock,
+             *        returns the size to lend. It may inspect the committed memory or throw,
+             *        and may relocate or extend the lendable memory.
+             */
+            owning_view(Manager *manager, std::invocable<size_t, size_t> auto &&measure) : manager { manager } {
+                guard lock { *manager };
+                if constexpr (!reading && manages_lifetime)
+                    if (!manager->nodes.empty())
+                        throw std::logic_error("only one write view can be lent with uninitialized_storage");
+                size_t n;
+                try {
+                    n = measure(manager->lendable_begin, get_distance(manager->lendable_begin + R, manager->lendable_end));
+                } catch (std::out_of_range &) {
+                    manager->counters.failures.add();
+                    STREAMBUF_PROBE(lend_failed, &manager->buffer, int(Consuming), manager->lendable_begin, 0);
+                    manager->buffer.recorder.record(trace_op::fail, manager->lendable_begin, 0);
+                    throw;
+                }
                 size_t lendable_begin = manager->lendable_begin;
                 size_t available_size = get_distance(lendable_begin + R, manager->lendable_end);
-                if (n > available_size)
+                if (n > available_size) {
+                    manager->counters.failures.add();
+                    STREAMBUF_PROBE(lend_failed, &manager->buffer, int(Consuming), lendable_begin, n);
+                    manager->buffer.recorder.record(trace_op::fail, lendable_begin, n);
                     throw std::out_of_range("borrow size too large");
-                manager->nodes.push_back(lendable_begin);
+                }
+                manager->counters.lends.add();
+                STREAMBUF_PROBE(lend, &manager->buffer, int(Consuming), lendable_begin, n);
+                manager->buffer.recorder.record(reading ? trace_op::read : trace_op::prepare, lendable_begin, n);
+                manager->nodes.push_back({ lendable_begin });
                 it = std::prev(manager->nodes.end());
                 start = lendable_begin;
                 stop = (lendable_begin + n) % N;
                 manager->lendable_begin = stop;
             }
-            owning_view(Manager *manager) : manager { manager } {
-                std::lock_guard lock(manager->mutex);
-                start = manager->lendable_begin;
-                size_t n = get_distance(start + R, manager->lendable_end);
-                manager->nodes.push_back(start);
-                it = std::prev(manager->nodes.end());
-                stop = (start + n) % N;
-                manager->lendable_begin = stop;
-            }
+            owning_view(Manager *manager, size_t n) : owning_view(manager, [n](size_t, size_t) { return n; }) { }
+            owning_view(Manager *manager) : owning_view(manager, [](size_t, size_t available) { return available; }) { }
             void swap(this auto &&self, owning_view &other) noexcept {
                 std::swap(self.manager, other.manager);
                 std::swap(self.start, other.start);
                 std::swap(self.stop, other.stop);
                 std::swap(self.it, other.it);
+                std::swap(self.constructed, other.constructed);
             }
             Manager *manager = nullptr;
             size_t start;
             size_t stop;
-            std::list<size_t>::iterator it; // the iterator of `start` in `manager->nodes`
+            mutable size_t constructed = 0; // the number of elements emplaced from the start, with `uninitialized_storage`
+            typename std::list<node>::iterator it; // the node of this view in `manager->nodes`
         };
 
         /**
@@ -166,10 +727,229 @@ class StreamBuffer : public view_interface<StreamBuffer<T, N, S>> {
          * @note This function will not throw and will return an empty view if no space or data is available.
          */
         def lend() noexcept { return owning_view(this); }
+
+        /**
+         * @brief Lend a view whose size is decided under the manager's lock.
+         * @param measure called as `measure(lendable_begin, available_size)`, returns the size to lend
+         * @return a view for reading or writing
+         * @throw std::out_of_range if the returned size exceeds the available space or data
+         */
+        def lend_with(std::invocable<size_t, size_t> auto &&measure) { return owning_view(this, measure); }
+
+        /**
+         * @brief Get the oldest lent view, which holds back the memory of every view lent after it
+         */
+        std::optional<outstanding_view> oldest() {
+            guard lock { *this };
+            if (nodes.empty())
+                return std::nullopt;
+            return outstanding_view { nodes.front().begin, nodes.front().lent.elapsed() };
+        }
     };
 
-    Manager<0> read_manager { *this, before_start, start, stop };       // The manager for `read()`.
-    Manager<1> write_manager { *this, stop, after_stop, before_start }; // The manager for `prepare()`.
+    Manager<0, true> read_manager { *this, before_start, start, stop, &StreamBuffer::release }; // The manager for `read()`.
+    Manager<1, false> write_manager { *this, stop, after_stop, writable_end, &StreamBuffer::committed }; // The manager for `prepare()`.
+
+    /**
+     * @brief An eventfd that is signaled by the first change after its last reset
+     *        that leaves at least `threshold` elements, see `enable_eventfd()`.
+     * @note The coroutines in `async_wait_ready()` do not share it, each one registers an eventfd
+     *       of its own in `waiters` that is signaled by the next change, whatever its amount.
+     */
+    struct readiness {
+        int fd = -1;
+        size_t threshold = 1;
+        std::atomic<bool> signaled = false;
+        std::atomic<size_t> changes = 0;    // the number of changes, to detect one between a check and a wait
+        std::atomic<size_t> waiting = 0;    // the size of `waiters`
+        std::vector<int> waiters {};        // the eventfds of the waiting coroutines
+        std::mutex mutex {};                // the mutex to protect `waiters`
+        [[no_unique_address]] stat_counter waits, wakeups;
+        void notify(size_t amount) noexcept {
+            if (amount >= threshold)
+                signal();
+            changed();
+        }
+        void wake() noexcept {
+            signal();
+            changed();
+        }
+        void signal() noexcept {
+#if defined(STREAMBUF_HAS_EVENTFD)
+            if (fd >= 0 && !signaled.exchange(true))
+                eventfd_write(fd, 1);
+#endif
+        }
+        void changed() noexcept {
+#if defined(STREAMBUF_HAS_EVENTFD)
+            if (fd < 0)
+                return;
+            changes.fetch_add(1);
+            if (waiting.load() == 0)
+                return;
+            std::lock_guard lock(mutex);
+            for (int waiter : waiters)
+                eventfd_write(waiter, 1);
+            waiters.clear();
+            waiting.store(0);
+#endif
+        }
+        void reset() noexcept {
+#if defined(STREAMBUF_HAS_EVENTFD)
+            eventfd_t value;
+            eventfd_read(fd, &value);
+            signaled = false;
+#endif
+        }
+        ~readiness() {
+#if defined(STREAMBUF_HAS_EVENTFD)
+            if (fd >= 0)
+                ::close(fd);
+#endif
+        }
+    };
+    readiness readable {};  // signaled when enough data is committed
+    readiness writable {};  // signaled when enough space is reclaimed
+    std::atomic<bool> end_of_stream = false; // set by `close()`
+
+    /**
+     * @brief The commit times of the recent batches, to measure how long data stays in the buffer
+     * @note The write manager pushes a mark at each commit and the read manager pops the marks
+     *       it moved past, each under its own lock. A commit is not timed if 64 marks are pending,
+     *       nor if it is dropped by `prepare_overwrite()` before being read.
+     */
+    struct commit_times {
+#if defined(STREAMBUF_ENABLE_STATS)
+        struct mark {
+            size_t position;    // the end of the committed batch
+            std::uint64_t time; // the ticks of `stat_clock` at the commit
+        };
+        std::array<mark, 64> marks {};
+        std::atomic<size_t> head = 0;   // the number of marks pushed
+        std::atomic<size_t> tail = 0;   // the number of marks popped
+        size_t consumed = 0;            // the position the marks were last checked at
+        stat_histogram ages {};         // in ticks of `stat_clock`
+
+        void push(size_t stop) noexcept {
+            size_t index = head.load(std::memory_order_relaxed);
+            if (index - tail.load(std::memory_order_acquire) == marks.size())
+                return;
+            marks[index % marks.size()] = { stop, stat_clock::now() };
+            head.store(index + 1, std::memory_order_release);
+        }
+
+        void pop(size_t start, bool dropped) noexcept {
+            size_t index = tail.load(std::memory_order_relaxed), last = head.load(std::memory_order_acquire);
+            size_t moved = get_distance(consumed, start);
+            std::uint64_t now = 0;
+            for (; index != last; ++index) {
+                size_t distance = get_distance(consumed, marks[index % marks.size()].position);
+                if (distance == 0 || distance > moved)
+                    break;
+                if (dropped)
+                    continue;
+                if (now == 0)
+                    now = stat_clock::now();
+                ages.record(now - marks[index % marks.size()].time);
+            }
+            tail.store(index, std::memory_order_release);
+            consumed = start;
+        }
+
+        void reset(size_t start) noexcept {
+            tail.store(head.load(std::memory_order_relaxed), std::memory_order_release);
+            consumed = start;
+        }
+#else
+        void push(size_t) noexcept { }
+        void pop(size_t, bool) noexcept { }
+        void reset(size_t) noexcept { }
+#endif
+    };
+    [[no_unique_address]] commit_times latency {};
+
+    /**
+     * @brief Notify the readers after a view was committed
+     */
+    void committed() noexcept {
+        if constexpr (persists_positions)
+            storage.store_committed(stop);
+        high_water.max(size());
+        latency.push(stop);
+        readable.notify(size());
+    }
+
+    /**
+     * @brief Record the consumed position after `read()` moved past some data
+     * @param dropped whether the data was dropped by `prepare_overwrite()`, so that its age is not recorded
+     */
+    void consumed(bool dropped = false) noexcept {
+        if constexpr (persists_positions)
+            storage.store_consumed(before_start);
+        latency.pop(before_start, dropped);
+    }
+
+    /**
+     * @brief Record both positions after the buffer was cleared, assigned or linearized
+     * @note Both managers must be locked.
+     */
+    void persist() noexcept {
+        latency.reset(before_start);
+        if constexpr (persists_positions) {
+            storage.store_consumed(before_start);
+            storage.store_committed(stop);
+        }
+    }
+
+public:
+    class subscriber;
+private:
+    std::list<subscriber *> subscribers {}; // the attached subscribers
+    std::mutex subscribers_mutex {};        // the mutex to protect the subscribers and `writable_end`
+
+    /**
+     * @brief Let the writer reuse the memory that `read()` and every subscriber have moved past
+     * @note `subscribers_mutex` must be locked. Every cursor is at or after `writable_end`,
+     *       so the oldest one is the nearest to it.
+     */
+    void reclaim_locked() noexcept {
+        size_t end = before_start, oldest = get_distance(writable_end, before_start);
+        for (auto *subscriber : subscribers)
+            if (size_t distance = get_distance(writable_end, subscriber->before_start); distance < oldest)
+                end = subscriber->before_start, oldest = distance;
+        writable_end = end;
+        writable.notify(space());
+    }
+
+    /**
+     * @brief Reclaim the memory after a subscriber returned a view
+     */
+    void reclaim() noexcept {
+        std::lock_guard lock(subscribers_mutex);
+        reclaim_locked();
+    }
+
+    /**
+     * @brief Reclaim the memory after `read()` returned a view
+     * @note Only the read manager is locked when there are no subscribers, which are attached or detached under it.
+     */
+    void release() noexcept {
+        consumed();
+        if (subscribers.empty()) {
+            writable_end = before_start;
+            writable.notify(space());
+        } else
+            reclaim();
+    }
+
+    /**
+     * @brief Move every subscriber to `pos`, used when the buffer is cleared or assigned
+     */
+    void reset_subscribers(size_t pos) noexcept {
+        std::lock_guard lock(subscribers_mutex);
+        for (auto *subscriber : subscribers)
+            subscriber->before_start = subscriber->start = pos;
+    }
 
     /**************************************** UTILITIES ****************************************/
 
@@ -181,6 +961,46 @@ class StreamBuffer : public view_interface<StreamBuffer<T, N, S>> {
         co_await boost::asio::steady_timer(co_await boost::asio::this_coro::executor, time).async_wait(boost::asio::use_awaitable);
     }
 
+    /**
+     * @brief Asyncronously wait until `ready` changes, or yield if its eventfd is not enabled
+     * @param seen `ready.changes` before the buffer was last checked, so that a change since then returns at once
+     * @note The coroutine waits on an eventfd of its own, so a waiter never consumes the wakeup of another.
+     */
+    boost::asio::awaitable<void> async_wait_ready(readiness &ready, size_t seen) noexcept {
+        ready.waits.add();
+        STREAMBUF_PROBE(wait_start, this, int(&ready == &readable), size(), space());
+        recorder.record(trace_op::wait, &ready == &readable ? stop : after_stop, size() << 32 | space());
+#if defined(STREAMBUF_HAS_EVENTFD)
+        if (int fd; ready.fd >= 0 && (fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) >= 0) {
+            boost::asio::posix::stream_descriptor descriptor(co_await boost::asio::this_coro::executor, fd);
+            struct registration {
+                readiness &ready;
+                int fd;
+                ~registration() {
+                    std::lock_guard lock(ready.mutex);
+                    std::erase(ready.waiters, fd);
+                    ready.waiting.store(ready.waiters.size());
+                }
+            } registered { ready, fd };
+            {
+                std::lock_guard lock(ready.mutex);
+                ready.waiters.push_back(fd);
+                ready.waiting.store(ready.waiters.size());
+            }
+            if (ready.changes.load() == seen)
+                co_await descriptor.async_wait(boost::asio::posix::stream_descriptor::wait_read, boost::asio::use_awaitable);
+            ready.wakeups.add();
+            STREAMBUF_PROBE(wait_done, this, int(&ready == &readable), size(), space());
+            recorder.record(trace_op::wake, &ready == &readable ? stop : after_stop, size() << 32 | space());
+            co_return;
+        }
+#endif
+        co_await async_sleep(0ms);
+        ready.wakeups.add();
+        STREAMBUF_PROBE(wait_done, this, int(&ready == &readable), size(), space());
+        recorder.record(trace_op::wake, &ready == &readable ? stop : after_stop, size() << 32 | space());
+    }
+
     /**
      * @brief Check if the index is out of range
      * @param index
@@ -191,20 +1011,133 @@ class StreamBuffer : public view_interface<StreamBuffer<T, N, S>> {
             throw std::out_of_range("index out of range");
     }
 
-    def swap(StreamBuffer<T, N> &other) noexcept {
-        std::swap(storage, other.storage);
-        std::swap(before_start, other.before_start);
-        std::swap(start, other.start);
-        std::swap(stop, other.stop);
-        std::swap(after_stop, other.after_stop);
+    /**
+     * @brief Split the circular range `[first, last)` of the storage into its contiguous parts
+     * @return the part before the end of the storage and the part after it, which may be empty
+     */
+    template<class V>
+    static def split(V *data, size_t first, size_t last) noexcept -> std::array<std::span<V>, 2> {
+        if (first <= last)
+            return { std::span(data + first, last - first), std::span<V>() };
+        return { std::span(data + first, N - first), std::span(data, last) };
     }
 
+    /**
+     * @brief Copy the committed data of `other` to the same positions in this buffer
+     * @note Only `[start, stop)` is copied, and the views lent by `other` are not carried over.
+     */
     void assign(const StreamBuffer<T, N, S> &other) noexcept {
-        storage = other.storage;
-        before_start = other.before_start;
-        start = other.start;
-        stop = other.stop;
-        after_stop = other.after_stop;
+        if constexpr (manages_lifetime)
+            std::destroy(begin(), end());
+        for (auto segment : other.segments()) {
+            auto *target = storage.data() + (segment.data() - other.storage.data());
+            if constexpr (manages_lifetime)
+                std::uninitialized_copy(segment.begin(), segment.end(), target);
+            else
+                std::copy(segment.begin(), segment.end(), target);
+        }
+        writable_end = before_start = start = other.start;
+        after_stop = stop = other.stop;
+        aligned_padding = other.aligned_padding.load();
+        reset_subscribers(stop);
+        persist();
+    }
+
+    /**
+     * @brief Move the committed data of `other` to the same positions in this buffer
+     * @note Only `[start, stop)` is moved, and `other` is left empty.
+     */
+    void assign(StreamBuffer<T, N, S> &&other) noexcept {
+        if constexpr (manages_lifetime)
+            std::destroy(begin(), end());
+        for (auto segment : other.segments()) {
+            auto *target = storage.data() + (segment.data() - other.storage.data());
+            if constexpr (manages_lifetime)
+                std::uninitialized_move(segment.begin(), segment.end(), target);
+            else
+                std::move(segment.begin(), segment.end(), target);
+        }
+        if constexpr (manages_lifetime)
+            std::destroy(other.begin(), other.end());
+        writable_end = before_start = start = other.start;
+        after_stop = stop = other.stop;
+        aligned_padding = other.aligned_padding.exchange(N);
+        reset_subscribers(stop);
+        persist();
+        other.writable_end = other.before_start = other.start = other.stop = other.after_stop = 0;
+        other.reset_subscribers(0);
+        other.persist();
+    }
+
+    /**
+     * @brief Move the committed data to the beginning of the storage
+     * @note Both managers must be locked. The data is moved only when no view is lent,
+     *       and is left in place if it is already contiguous while some views are lent.
+     *       An empty buffer only has its positions reset.
+     * @note The padding of the message API is moved like data, so its records must not be linearized.
+     * @throw std::logic_error if the data wraps around while some views are lent,
+     *        or if it holds the padding of `prepare_aligned()`
+     */
+    void linearize_locked() {
+        if (start == 0)
+            return;
+        if (!read_manager.nodes.empty() || !write_manager.nodes.empty() || !subscribers.empty()) {
+            if (start > stop)
+                throw std::logic_error("cannot linearize while views are lent or subscribers are attached");
+            return;
+        }
+        size_t n = size();
+        if (n != 0 && aligned_padding.load(std::memory_order_relaxed) != N)
+            throw std::logic_error("cannot linearize the padding of prepare_aligned()");
+        if (start < stop)
+            std::move(storage.data() + start, storage.data() + stop, storage.data());
+        else if (start > stop)
+            std::rotate(storage.data(), storage.data() + start, storage.data() + N);
+        writable_end = before_start = start = 0;
+        after_stop = stop = n;
+        aligned_padding = N;
+        persist();
+    }
+
+    /**
+     * @brief Get the number of elements in a block of `align` bytes
+     * @throw std::invalid_argument if the storage is not aligned to `align` or not made of whole blocks
+     */
+    size_t aligned_block(size_t align) const {
+        if (align == 0 || align % sizeof(T) != 0 || N * sizeof(T) % align != 0 || reinterpret_cast<std::uintptr_t>(storage.data()) % align != 0)
+            throw std::invalid_argument("storage is not aligned to the block size");
+        return align / sizeof(T);
+    }
+
+    /**************************************** MESSAGES ****************************************/
+
+    using message_header = std::uint32_t;  // the length of the payload that follows the header
+    static constexpr size_t message_header_size = sizeof(message_header);
+    static constexpr message_header message_padding = std::numeric_limits<message_header>::max(); // skip to the end of the storage
+
+    /**
+     * @brief Locate the message whose record begins at `pos`
+     * @note A record is `[padding] header payload`. The padding covers the rest of the storage
+     *       when the header or the payload would wrap around, so the payload is always contiguous.
+     * @return the offset of the payload and its length
+     */
+    static std::pair<size_t, size_t> locate_message(const T *storage, size_t pos) noexcept {
+        message_header length;
+        if (N - pos >= message_header_size) {
+            std::memcpy(&length, storage + pos, message_header_size);
+            if (length != message_padding)
+                return { pos + message_header_size, length };
+        }
+        std::memcpy(&length, storage, message_header_size);
+        return { message_header_size, length };
+    }
+
+    /**
+     * @brief Get the size of the record that begins at `pos`
+     */
+    static size_t record_size(const T *storage, size_t pos) noexcept {
+        auto [offset, length] = locate_message(storage, pos);
+        return get_distance(pos, (offset + length) % N);
     }
 
 public:
@@ -216,10 +1149,136 @@ public:
     using read_view = typename decltype(read_manager)::owning_view;
     using write_view = typename decltype(write_manager)::owning_view;
 
+    /**
+     * @brief A contiguous span together with the view that owns it, such as the payload of a message.
+     * @note The owned memory is committed or consumed when the contiguous view is destroyed.
+     * @tparam V `read_view` or `write_view`
+     */
+    template<class V>
+    struct contiguous_view : view_interface<contiguous_view<V>> {
+        contiguous_view(V &&view, std::span<T> payload) noexcept : view { std::move(view) }, payload { payload } { }
+        def begin() const noexcept { return payload.data(); }
+        def end() const noexcept { return payload.data() + payload.size(); }
+        def data() const noexcept { return payload.data(); }
+    private:
+        V view;
+        std::span<T> payload;
+    };
+
+    /**
+     * @brief Several messages consumed together under a single view.
+     * @note Iterating the batch yields the payload of each message as `std::span<T>`.
+     */
+    struct message_batch : view_interface<message_batch> {
+        struct iterator {
+            using value_type = std::span<T>;
+            using difference_type = std::ptrdiff_t;
+            T *storage = nullptr;
+            size_t pos = 0;         // the beginning of the current record
+            size_t remaining = 0;   // the number of messages left, including the current one
+            std::span<T> operator*() const noexcept { auto [offset, length] = locate_message(storage, pos); return { storage + offset, length }; }
+            iterator &operator++() noexcept { pos = (pos + record_size(storage, pos)) % N; --remaining; return *this; }
+            iterator operator++(int) noexcept { auto temp = *this; ++*this; return temp; }
+            bool operator==(const iterator &other) const noexcept { return remaining == other.remaining; }
+            bool operator==(std::default_sentinel_t) const noexcept { return remaining == 0; }
+        };
+        message_batch(read_view &&view, size_t count) noexcept : view { std::move(view) }, count { count } { }
+        iterator begin() const noexcept { auto it = view.begin(); return { it.storage, it.offset, count }; }
+        std::default_sentinel_t end() const noexcept { return {}; }
+        def size() const noexcept { return count; }
+    private:
+        read_view view;
+        size_t count;
+    };
+
+    using contiguous_read_view = contiguous_view<read_view>;
+    using contiguous_write_view = contiguous_view<write_view>;
+    using message_read_view = contiguous_view<read_view>;
+    using message_write_view = contiguous_view<write_view>;
+
+    /**
+     * @brief An independent read cursor that sees every element committed after it is attached.
+     * @note The writer cannot reuse any memory until `read()` and every subscriber have moved past it,
+     *       so one producer can feed several consumers with a single copy of the data.
+     *       The subscriber is detached at destruction, and none of its views may outlive it.
+     */
+    class subscriber {
+        friend class StreamBuffer;
+        StreamBuffer<T, N, S> &buffer;
+        size_t before_start;    // the start of the memory read by this subscriber
+        size_t start;           // the start of the memory not yet read by this subscriber
+        Manager<0, false> manager { buffer, before_start, start, buffer.stop, &StreamBuffer::reclaim };
+        typename std::list<subscriber *>::iterator it;
+    public:
+        using view = typename Manager<0, false>::owning_view;
+
+        explicit subscriber(StreamBuffer<T, N, S> &buffer) : buffer { buffer } {
+            static_assert(!manages_lifetime, "subscribers cannot share elements whose lifetimes are managed by the buffer");
+            std::scoped_lock lock(buffer.read_manager.mutex, buffer.write_manager.mutex, buffer.subscribers_mutex);
+            before_start = start = buffer.stop;
+            it = buffer.subscribers.insert(buffer.subscribers.end(), this);
+        }
+        subscriber(const subscriber &) = delete;
+        subscriber &operator=(const subscriber &) = delete;
+        ~subscriber() {
+            std::scoped_lock lock(buffer.read_manager.mutex, buffer.subscribers_mutex);
+            buffer.subscribers.erase(it);
+            buffer.reclaim_locked();
+        }
+
+        /**
+         * @brief Get the size of the data not yet read by this subscriber
+         */
+        def size() const noexcept { return get_distance(start, buffer.stop); }
+
+        /**
+         * @brief Check if this subscriber has read all committed data
+         */
+        def empty() const noexcept { return start == buffer.stop; }
+
+        /**
+         * @brief Read some data
+         * @param n the size to read
+         * @return a view for reading
+         * @throw std::out_of_range if not enough data is available
+         */
+        def read(size_t n) -> view { return manager.lend(n); }
+
+        /**
+         * @brief Read all available data
+         * @return a view for reading
+         * @note This function will not throw and will return an empty view if no data is available.
+         */
+        def read() noexcept -> view { return manager.lend(); }
+
+        /**
+         * @brief Asynchronously read some data
+         * @param n the size to read
+         * @return a view for reading, which is smaller only after `close()` and empty at the end of the stream
+         * @note This function will asynchronously wait until enough data is available.
+         */
+        boost::asio::awaitable<view> async_read(size_t n) noexcept {
+            while (true) {
+                bool last = buffer.closed();
+                try { co_return read(n); }
+                catch (std::out_of_range &) { }
+                if (last)
+                    co_return read();
+                co_await async_sleep(0ms);
+            }
+        }
+    };
+
     /************************** CONSTRUCTORS **************************/
     
     template<typename ...Args> requires requires { S { std::declval<Args>()... }; }
-    StreamBuffer(Args &&...args) noexcept : storage { std::forward<Args>(args)... } { }
+    StreamBuffer(Args &&...args) noexcept(noexcept(S { std::declval<Args>()... })) : storage { std::forward<Args>(args)... } {
+        if constexpr (persists_positions) {
+            auto [first, last] = storage.positions();
+            writable_end = before_start = start = first;
+            after_stop = stop = last;
+        }
+    }
     StreamBuffer(StreamBuffer<T, N, S> &other) noexcept {
         std::scoped_lock lock(other.read_manager.mutex, other.write_manager.mutex);
         assign(other);
@@ -227,7 +1286,7 @@ public:
     StreamBuffer(const StreamBuffer<T, N, S> &other) = default;
     StreamBuffer(StreamBuffer<T, N, S> &&other) noexcept {
         std::scoped_lock lock(other.read_manager.mutex, other.write_manager.mutex);
-        swap(other);
+        assign(std::move(other));
     }
     def &operator=(StreamBuffer<T, N, S> &other) noexcept {
         std::scoped_lock lock(read_manager.mutex, write_manager.mutex, other.read_manager.mutex, other.write_manager.mutex);
@@ -241,16 +1300,27 @@ public:
     }
     def &operator=(StreamBuffer<T, N, S> &&other) noexcept {
         std::scoped_lock lock(read_manager.mutex, write_manager.mutex, other.read_manager.mutex, other.write_manager.mutex);
-        swap(other);
+        assign(std::move(other));
         return *this;
     }
 
+    ~StreamBuffer() {
+        if constexpr (manages_lifetime)
+            std::destroy(begin(), end());
+    }
+
     /******************************** ITERATOR ******************************/
     // const iterators, reverse iterators and const reverse iterators are defined by view_interface
 
     def begin(this auto &&self) noexcept { return self.make_iterator(self.start); }
     def end(this auto &&self) noexcept { return self.make_iterator(self.stop); }
 
+    /**
+     * @brief Get the committed data as contiguous parts
+     * @return the part before the end of the storage and the part after it, which may be empty
+     */
+    def segments(this auto &&self) noexcept { return split(self.storage.data(), self.start, self.stop); }
+
 
     /******************************** ACCESS ********************************/
 
@@ -259,8 +1329,38 @@ public:
      */
     def clear() noexcept {
         std::scoped_lock lock(read_manager.mutex, write_manager.mutex);
-        before_start = start = stop = after_stop = 0;
+        if constexpr (manages_lifetime)
+            std::destroy(begin(), end());
+        writable_end = before_start = start = stop = after_stop = 0;
+        aligned_padding = N;
+        reset_subscribers(0);
+        persist();
+        readable.wake();
+        writable.wake();
     }
+    /**
+     * @brief Take a snapshot of the buffer
+     * @return a new buffer holding a copy of the committed data
+     * @note Only the committed data is copied, so the cost is proportional to `size()`.
+     */
+    def snapshot() -> StreamBuffer<T, N, S> { return StreamBuffer<T, N, S>(*this); }
+
+    /**
+     * @brief Copy the committed data into `out`
+     * @param out the target, which must hold at least `size()` elements
+     * @return the part of `out` that was written
+     * @throw std::out_of_range if `out` is too small
+     */
+    def snapshot(std::span<T> out) -> std::span<T> {
+        std::scoped_lock lock(read_manager.mutex, write_manager.mutex);
+        if (out.size() < size())
+            throw std::out_of_range("snapshot target too small");
+        auto it = out.begin();
+        for (auto segment : segments())
+            it = std::ranges::copy(segment, it).out;
+        return out.first(size());
+    }
+
     /**
      * @brief Get the size of the buffer
      * @return the size of the buffer as `size_t`
@@ -273,11 +1373,17 @@ public:
      */
     def max_size() const noexcept { return N - 1; }
 
+    /**
+     * @brief Get the size of the space available for `prepare()`
+     * @return the size of the space as `size_t`
+     */
+    def space() const noexcept { return get_distance(after_stop + 1, writable_end); }
+
     /**
      * @brief Check if the buffer is full
      * @return `true` if the buffer is full, `false` otherwise
      */
-    def full() const noexcept { return (stop + 1) % N == start; }
+    def full() const noexcept { return space() == 0; }
 
     /**
      * @brief Check if the buffer is empty
@@ -323,8 +1429,61 @@ public:
      * @param n the size to prepare
      * @return a view for writing
      * @throw std::out_of_range if not enough space is available
+     * @throw std::logic_error if the buffer is closed, or with `uninitialized_storage` if another write view is lent
      */
-    def prepare(size_t n) -> write_view { return write_manager.lend(n); }
+    def prepare(size_t n) -> write_view {
+        if (closed())
+            throw std::logic_error("buffer is closed");
+        return write_manager.lend(n);
+    }
+
+    /**
+     * @brief Prepare all available space for writing
+     * @return a view for writing, which is empty if the buffer is full
+     * @note Use `write_view::shrink()` to commit only what was written.
+     * @throw std::logic_error if the buffer is closed, or with `uninitialized_storage` if another write view is lent
+     */
+    def prepare() -> write_view {
+        if (closed())
+            throw std::logic_error("buffer is closed");
+        return write_manager.lend();
+    }
+
+    /**
+     * @brief Prepare a space for writing, dropping the oldest data if the buffer is full
+     * @param n the size to prepare
+     * @return a view for writing
+     * @note Only committed data that is not lent to a reader is dropped, so readers never see
+     *       overwritten elements. Use `take_dropped()` to learn how many elements were lost.
+     * @throw std::out_of_range if `n` is larger than `max_size()`, or if the space is held by lent views or subscribers
+     * @throw std::logic_error if the buffer is closed
+     */
+    def prepare_overwrite(size_t n) -> write_view {
+        if (closed())
+            throw std::logic_error("buffer is closed");
+        return write_manager.lend_with([&](size_t, size_t available) {
+            if (n <= available)
+                return n;
+            std::lock_guard lock(read_manager.mutex);
+            size_t lost = n - available;
+            if (read_manager.nodes.empty() && subscribers.empty() && lost <= size()) {
+                if constexpr (manages_lifetime)
+                    std::destroy(begin(), begin() + lost);
+                writable_end = before_start = start = (start + lost) % N;
+                dropped.fetch_add(lost, std::memory_order_relaxed);
+                STREAMBUF_PROBE(overwrite, this, start, lost);
+                recorder.record(trace_op::drop, start, lost);
+                consumed(true);
+            }
+            return n;
+        });
+    }
+
+    /**
+     * @brief Get and reset the number of elements dropped by `prepare_overwrite()`
+     * @return the number of elements lost since the last call
+     */
+    def take_dropped() noexcept -> std::uint64_t { return dropped.exchange(0, std::memory_order_relaxed); }
 
     /**
      * @brief Read some data
@@ -341,31 +1500,435 @@ public:
      */
     def read() noexcept -> read_view { return read_manager.lend(); }
 
+    /**
+     * @brief Make the committed data contiguous
+     * @return the committed data as `std::span<T>`
+     * @note The data is rotated to the beginning of the storage if no view is lent.
+     *       It must not hold records of the message API, whose padding would be moved with the data.
+     * @throw std::logic_error if the data wraps around while some views are lent,
+     *        or if it holds the padding of `prepare_aligned()`
+     */
+    def linearize() -> std::span<T> requires (!manages_lifetime) {
+        std::scoped_lock lock(read_manager.mutex, write_manager.mutex);
+        linearize_locked();
+        return { storage.data() + start, size() };
+    }
+
+    /**
+     * @brief Read some contiguous data
+     * @param n the size to read
+     * @return a contiguous view for reading, convertible to `std::span<T>`
+     * @note The data is linearized only if the `n` elements wrap around the end of the storage.
+     * @throw std::out_of_range if not enough data is available
+     * @throw std::logic_error if the data must be linearized while some views are lent
+     */
+    def read_contiguous(size_t n) -> contiguous_read_view requires (!manages_lifetime) {
+        std::lock_guard lock(write_manager.mutex);
+        auto view = read_manager.lend_with([&](size_t begin, size_t available) {
+            if (n > available)
+                throw std::out_of_range("borrow size too large");
+            if (begin + n > N)
+                linearize_locked();
+            return n;
+        });
+        T *data = &*view.begin();
+        return { std::move(view), std::span(data, n) };
+    }
+
+    /**
+     * @brief Prepare a contiguous space for direct I/O
+     * @param n the size to prepare, rounded up to a whole number of blocks
+     * @param align the block size in bytes, such as the logical block size of an `O_DIRECT` file
+     * @return a contiguous view for writing that starts on a block boundary
+     * @note If the space would wrap around, the rest of the storage is skipped as padding and the view
+     *       starts at the beginning of the storage. The padding is committed with the view and skipped
+     *       by `read_aligned()`, so both sides should use the aligned API.
+     * @throw std::out_of_range if not enough space is available
+     * @throw std::invalid_argument if the storage is not aligned to `align`, see `aligned_storage`
+     * @throw std::logic_error if the buffer is closed, or if the write position is not on a block boundary
+     */
+    def prepare_aligned(size_t n, size_t align = 4096) -> contiguous_write_view requires (!manages_lifetime) {
+        if (closed())
+            throw std::logic_error("buffer is closed");
+        size_t block = aligned_block(align);
+        n = (n + block - 1) / block * block;
+        size_t pos, offset;
+        auto view = write_manager.lend_with([&](size_t begin, size_t) {
+            if (begin % block != 0)
+                throw std::logic_error("write position is not aligned");
+            pos = begin;
+            offset = begin + n <= N ? begin : 0;
+            return (offset == 0 && begin != 0 ? N - begin : 0) + n;
+        });
+        if (offset == 0 && pos != 0)
+            aligned_padding.store(pos, std::memory_order_release);
+        return { std::move(view), std::span(storage.data() + offset, n) };
+    }
+
+    /**
+     * @brief Read some contiguous data for direct I/O
+     * @param max the maximum size to read
+     * @param align the block size in bytes
+     * @return a contiguous view for reading that starts on a block boundary and holds whole blocks,
+     *         which is empty if less than a block is available before the end of the storage
+     * @note The padding skipped by `prepare_aligned()` is consumed with the view.
+     * @throw std::invalid_argument if the storage is not aligned to `align`, see `aligned_storage`
+     * @throw std::logic_error if the read position is not on a block boundary
+     */
+    def read_aligned(size_t max, size_t align = 4096) -> contiguous_read_view requires (!manages_lifetime) {
+        size_t block = aligned_block(align);
+        size_t offset, n;
+        auto view = read_manager.lend_with([&](size_t begin, size_t available) {
+            if (begin % block != 0)
+                throw std::logic_error("read position is not aligned");
+            size_t skip = begin == aligned_padding.load(std::memory_order_acquire) && available > N - begin ? N - begin : 0;
+            offset = (begin + skip) % N;
+            n = std::min({ max, available - skip, N - offset }) / block * block;
+            if (n == 0)
+                return size_t(0);
+            if (skip != 0)
+                aligned_padding.store(N, std::memory_order_relaxed);
+            return skip + n;
+        });
+        return { std::move(view), std::span(storage.data() + offset, n) };
+    }
+
+    /**
+     * @brief Write the data and the positions of a persistent storage to disk, see `mapped_storage`
+     * @throw std::system_error if the data cannot be written
+     */
+    void sync() requires persists_positions { storage.sync(); }
+
+#if defined(STREAMBUF_HAS_EVENTFD)
+    /**
+     * @brief Create eventfds that signal readiness, which also replace polling in the asynchronous API
+     * @param read_threshold the committed size that makes `readable_fd()` readable
+     * @param write_threshold the free space that makes `writable_fd()` readable
+     * @note A descriptor is signaled by the first commit or consume after its last reset that
+     *       crosses its threshold. Reset it with `reset_readable()` or `reset_writable()`
+     *       before checking the buffer again, so that no change is missed.
+     * @throw std::system_error if an eventfd cannot be created
+     */
+    void enable_eventfd(size_t read_threshold = 1, size_t write_threshold = 1) {
+        for (auto [ready, threshold] : { std::pair { &readable, read_threshold }, std::pair { &writable, write_threshold } }) {
+            if (ready->fd < 0 && (ready->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+                throw std::system_error(errno, std::system_category(), "eventfd");
+            ready->threshold = threshold;
+        }
+        readable.notify(size());
+        writable.notify(space());
+    }
+
+    /**
+     * @brief Get the eventfd signaled when enough data is committed, or -1 if not enabled
+     */
+    def readable_fd() const noexcept { return readable.fd; }
+
+    /**
+     * @brief Get the eventfd signaled when enough space is available, or -1 if not enabled
+     */
+    def writable_fd() const noexcept { return writable.fd; }
+
+    /**
+     * @brief Reset `readable_fd()`, call it before checking the buffer for data
+     */
+    void reset_readable() noexcept { readable.reset(); }
+
+    /**
+     * @brief Reset `writable_fd()`, call it before checking the buffer for space
+     */
+    void reset_writable() noexcept { writable.reset(); }
+#endif
+
+    /**
+     * @brief Get a snapshot of the counters
+     * @return the counters, which are all 0 unless `STREAMBUF_ENABLE_STATS` is defined
+     * @note The counters are read without locking, so this can be called from a monitoring thread
+     *       at any time. Each counter is exact, but they are not read at the same instant.
+     */
+    def stats() const noexcept -> buffer_stats {
+        auto snapshot = [](const auto &manager, const readiness &ready) {
+            return buffer_stats::manager {
+                manager.counters.lends.load(), manager.counters.returns.load(), manager.counters.failures.load(),
+                manager.counters.elements.load(), ready.waits.load(), ready.wakeups.load(), manager.counters.hold_ns.load(),
+                manager.counters.acquisitions.load(), manager.counters.contended.load(), manager.counters.wait_ns.load(),
+                manager.counters.wait_times.load(), manager.counters.hold_times.load(), manager.counters.view_times.load(),
+            };
+        };
+        buffer_stats result { snapshot(write_manager, writable), snapshot(read_manager, readable) };
+        result.bytes_committed = result.write.elements * sizeof(T);
+        result.bytes_consumed = result.read.elements * sizeof(T);
+        result.high_water = high_water.load();
+#if defined(STREAMBUF_ENABLE_STATS)
+        result.queue_latency = latency.ages.load().scaled(stat_clock::ns_per_tick());
+#endif
+        return result;
+    }
+
+    /**
+     * @brief Get the last operations on the buffer
+     * @return up to `STREAMBUF_TRACE_CAPACITY` operations, from the oldest,
+     *         which is empty unless `STREAMBUF_ENABLE_TRACE` is defined
+     * @note The operations are read while the buffer keeps running, and the ones overwritten meanwhile are skipped.
+     */
+    def trace() const -> std::vector<trace_event> {
+        std::vector<trace_event> events;
+        recorder.for_each([&](const trace_event &event) { events.push_back(event); });
+        return events;
+    }
+
+#if defined(STREAMBUF_HAS_UNISTD)
+    /**
+     * @brief Write the last operations on the buffer to a file as text, one per line
+     * @param fd the file, such as `STDERR_FILENO`
+     * @note No memory is allocated and only `write` is called, so this can be used in a signal handler.
+     */
+    void write_trace(int fd) const noexcept {
+        static constexpr const char *names[] = { "prepare", "commit", "read", "consume", "fail", "drop", "wait", "wake" };
+        recorder.for_each([fd](const trace_event &event) {
+            char line[128], *p = line;
+            auto put = [&](const char *text) { while (*text) *p++ = *text++; };
+            auto put_number = [&](std::uint64_t value) {
+                char digits[20];
+                int n = 0;
+                do digits[n++] = char('0' + value % 10); while (value /= 10);
+                while (n > 0) *p++ = digits[--n];
+            };
+            put_number(event.timestamp), put(" "), put_number(event.thread), put(" ");
+            put(names[static_cast<size_t>(event.op)]), put(" "), put_number(event.position), put(" "), put_number(event.size), put("\n");
+            [[maybe_unused]] auto written = write(fd, line, p - line);
+        });
+    }
+#endif
+
+    /**
+     * @brief Get the oldest write view that has not been committed
+     * @return the view, or nothing if no view is lent for writing
+     * @note No commit is visible to readers until this view is returned, so a large age
+     *       points at the stage that stalls the buffer.
+     */
+    def oldest_write_view() -> std::optional<outstanding_view> { return write_manager.oldest(); }
+
+    /**
+     * @brief Get the oldest read view that has not been consumed
+     * @return the view, or nothing if no view is lent for reading
+     * @note No memory is reclaimed for writing until this view is returned.
+     */
+    def oldest_read_view() -> std::optional<outstanding_view> { return read_manager.oldest(); }
+
+    /**
+     * @brief Attach a subscriber
+     * @return a subscriber that sees every element committed from now on
+     */
+    def subscribe() -> subscriber { return subscriber(*this); }
+
+    /**
+     * @brief Move the first element out of the buffer
+     * @param out the element to move into
+     * @return `true` if an element was moved, `false` if the buffer is empty
+     */
+    def pop_into(T &out) -> bool {
+        auto view = read_manager.lend_with([](size_t, size_t available) { return std::min<size_t>(available, 1); });
+        if (view.empty())
+            return false;
+        out = std::move(view.front());
+        return true;
+    }
+
+    /**
+     * @brief Signal the end of the stream
+     * @note Afterwards the asynchronous reads return the remaining data and then an empty view,
+     *       and the prepare functions throw. The coroutines waiting on the buffer resume at once.
+     * @note Views still lent for writing are committed as usual, but readers may have seen
+     *       the end of the stream already, so return them before closing.
+     */
+    def close() noexcept {
+        end_of_stream.store(true, std::memory_order_release);
+        readable.wake();
+        writable.wake();
+    }
+
+    /**
+     * @brief Check if `close()` was called
+     */
+    def closed() const noexcept -> bool { return end_of_stream.load(std::memory_order_acquire); }
+
     /**
      * @brief Asynchronously prepare a space for writing
      * @param n the size to write
      * @return a view for writing
      * @note This function will asynchronously wait until enough space is available.
+     * @throw std::logic_error if the buffer is closed, also while waiting
      */
     boost::asio::awaitable<write_view> async_prepare(size_t n) noexcept {
         while (true) {
+            size_t seen = writable.changes.load();
             try { co_return prepare(n); }
             catch (std::out_of_range &) { }
-            co_await async_sleep(0ms);
+            co_await async_wait_ready(writable, seen);
+        }
+    }
+
+    /**
+     * @brief Asynchronously prepare all available space for writing
+     * @return a view for writing, which is never empty
+     * @note This function will asynchronously wait until some space is available.
+     * @throw std::logic_error if the buffer is closed, also while waiting
+     */
+    boost::asio::awaitable<write_view> async_prepare() noexcept {
+        while (true) {
+            size_t seen = writable.changes.load();
+            if (auto view = prepare(); !view.empty())
+                co_return std::move(view);
+            co_await async_wait_ready(writable, seen);
         }
     }
 
     /**
      * @brief Asynchronously read some data
      * @param n the size to read
-     * @return a view for reading
+     * @return a view for reading, which is smaller only after `close()` and empty at the end of the stream
      * @note This function will asynchronously wait until enough data is available.
      */
     boost::asio::awaitable<read_view> async_read(size_t n) noexcept {
         while (true) {
+            size_t seen = readable.changes.load();
+            bool last = closed();
             try { co_return read(n); }
             catch (std::out_of_range &) { }
-            co_await async_sleep(0ms);
+            if (last)
+                co_return read();
+            co_await async_wait_ready(readable, seen);
+        }
+    }
+
+    /**
+     * @brief Asynchronously read all available data
+     * @return a view for reading, which is empty only at the end of the stream
+     * @note This function will asynchronously wait until some data is available.
+     */
+    boost::asio::awaitable<read_view> async_read() noexcept {
+        while (true) {
+            size_t seen = readable.changes.load();
+            bool last = closed();
+            if (auto view = read(); !view.empty() || last)
+                co_return std::move(view);
+            co_await async_wait_ready(readable, seen);
+        }
+    }
+
+    /**
+     * @brief Asynchronously wait until all committed data is consumed
+     * @note With `close()`, this lets a producer shut down as soon as the consumers have caught up.
+     */
+    boost::asio::awaitable<void> async_drain() noexcept {
+        while (true) {
+            size_t seen = writable.changes.load();
+            if (drained())
+                co_return;
+            co_await async_wait_ready(writable, seen);
+        }
+    }
+
+    /**
+     * @brief Check if `read()` and every subscriber have moved past all committed data
+     */
+    bool drained() noexcept {
+        std::scoped_lock lock(read_manager.mutex, write_manager.mutex, subscribers_mutex);
+        return writable_end == stop;
+    }
+
+    /******************************** MESSAGES ********************************/
+    // Length-prefixed framing for `StreamBuffer<std::byte, N>`. Every record carries a compact header
+    // and is padded at the wrap point, so that each payload can be accessed as a contiguous span.
+
+    /**
+     * @brief Prepare a message for writing
+     * @param bytes the size of the payload
+     * @return a contiguous view of the payload
+     * @throw std::out_of_range if not enough space is available
+     * @throw std::logic_error if the buffer is closed
+     */
+    def prepare_message(size_t bytes) -> message_write_view requires std::same_as<T, std::byte> {
+        if (closed())
+            throw std::logic_error("buffer is closed");
+        if (bytes >= message_padding)
+            throw std::out_of_range("message too large");
+        size_t pos, offset;
+        auto view = write_manager.lend_with([&](size_t begin, size_t) {
+            pos = begin;
+            offset = N - begin >= message_header_size + bytes ? begin + message_header_size : message_header_size;
+            return (offset == message_header_size && begin != 0 ? N - begin : 0) + message_header_size + bytes;
+        });
+        auto length = static_cast<message_header>(bytes);
+        if (offset == message_header_size && pos != 0 && N - pos >= message_header_size)
+            std::memcpy(storage.data() + pos, &message_padding, message_header_size);
+        std::memcpy(storage.data() + offset - message_header_size, &length, message_header_size);
+        return { std::move(view), std::span(storage.data() + offset, bytes) };
+    }
+
+    /**
+     * @brief Read the next message
+     * @return a contiguous view of the payload
+     * @throw std::out_of_range if no message is available
+     */
+    def read_message() -> message_read_view requires std::same_as<T, std::byte> {
+        std::pair<size_t, size_t> located;
+        auto view = read_manager.lend_with([&](size_t begin, size_t available) {
+            if (available == 0)
+                throw std::out_of_range("no message available");
+            located = locate_message(storage.data(), begin);
+            return record_size(storage.data(), begin);
+        });
+        return { std::move(view), std::span(storage.data() + located.first, located.second) };
+    }
+
+    /**
+     * @brief Read up to `max` messages at once
+     * @param max the maximum number of messages to read
+     * @return a batch of messages
+     * @note This function will not throw and will return an empty batch if no message is available.
+     */
+    def read_messages(size_t max) noexcept -> message_batch requires std::same_as<T, std::byte> {
+        size_t count = 0;
+        auto view = read_manager.lend_with([&](size_t begin, size_t available) {
+            size_t total = 0;
+            for (; count < max && total < available; ++count)
+                total += record_size(storage.data(), (begin + total) % N);
+            return total;
+        });
+        return { std::move(view), count };
+    }
+
+    /**
+     * @brief Asynchronously prepare a message for writing
+     * @param bytes the size of the payload
+     * @return a contiguous view of the payload
+     * @note This function will asynchronously wait until enough space is available.
+     * @throw std::logic_error if the buffer is closed, also while waiting
+     */
+    boost::asio::awaitable<message_write_view> async_prepare_message(size_t bytes) noexcept requires std::same_as<T, std::byte> {
+        while (true) {
+            size_t seen = writable.changes.load();
+            try { co_return prepare_message(bytes); }
+            catch (std::out_of_range &) { }
+            co_await async_wait_ready(writable, seen);
+        }
+    }
+
+    /**
+     * @brief Asynchronously read the next message
+     * @return a contiguous view of the payload
+     * @note This function will asynchronously wait until a message is available.
+     * @throw std::out_of_range if the buffer is closed and no message is left
+     */
+    boost::asio::awaitable<message_read_view> async_read_message() noexcept requires std::same_as<T, std::byte> {
+        while (true) {
+            size_t seen = readable.changes.load();
+            bool last = closed();
+            try { co_return read_message(); }
+            catch (std::out_of_range &) { if (last) throw; }
+            co_await async_wait_ready(readable, seen);
         }
     }
 
@@ -374,6 +1937,129 @@ public:
 
 };
 
+/**
+ * @brief A range whose elements are stored in a few contiguous parts, see `StreamBuffer::segments()`.
+ */
+template<class R>
+concept segmented_range = std::ranges::random_access_range<R> && requires (R &r) {
+    { r.segments() } -> std::ranges::input_range;
+};
+
+/**
+ * @brief Range algorithms that run on each contiguous part of a `segmented_range`,
+ *        so that they are not slowed down by the wrap-around of the iterators.
+ * @note Other ranges are forwarded to the `std::ranges` algorithms.
+ */
+namespace segmented {
+
+    /**
+     * @brief Copy the elements of `r` to `out`
+     * @return the output iterator past the last copied element
+     */
+    def copy(std::ranges::input_range auto &&r, std::weakly_incrementable auto out) {
+        if constexpr (segmented_range<decltype(r)>) {
+            for (auto segment : r.segments())
+                out = std::ranges::copy(segment, std::move(out)).out;
+            return out;
+        } else
+            return std::ranges::copy(r, std::move(out)).out;
+    }
+
+    /**
+     * @brief Assign `value` to all elements of `r`
+     */
+    def fill(std::ranges::input_range auto &&r, const auto &value) -> void {
+        if constexpr (segmented_range<decltype(r)>) {
+            for (auto segment : r.segments())
+                std::ranges::fill(segment, value);
+        } else
+            std::ranges::fill(r, value);
+    }
+
+    /**
+     * @brief Find the first element equal to `value`
+     * @return the iterator to the element, or the end of `r` if not found
+     */
+    def find(std::ranges::input_range auto &&r, const auto &value) {
+        if constexpr (segmented_range<decltype(r)>) {
+            size_t offset = 0;
+            for (auto segment : r.segments()) {
+                auto it = std::ranges::find(segment, value);
+                offset += it - segment.begin();
+                if (it != segment.end())
+                    break;
+            }
+            return std::ranges::next(std::ranges::begin(r), std::ranges::range_difference_t<decltype(r)>(offset));
+        } else
+            return std::ranges::find(r, value);
+    }
+
+    /**
+     * @brief Count the elements equal to `value`
+     */
+    def count(std::ranges::input_range auto &&r, const auto &value) -> size_t {
+        if constexpr (segmented_range<decltype(r)>) {
+            size_t n = 0;
+            for (auto segment : r.segments())
+                n += std::ranges::count(segment, value);
+            return n;
+        } else
+            return std::ranges::count(r, value);
+    }
+
+    /**
+     * @brief Check if two ranges have the same elements
+     */
+    def equal(std::ranges::input_range auto &&r1, std::ranges::input_range auto &&r2) -> bool {
+        if constexpr (segmented_range<decltype(r1)> && segmented_range<decltype(r2)>) {
+            if (std::ranges::size(r1) != std::ranges::size(r2))
+                return false;
+            auto others = r2.segments();
+            auto other = others.begin();
+            auto rest = *other;
+            for (auto segment : r1.segments()) {
+                while (!segment.empty()) {
+                    while (rest.empty())
+                        rest = *++other;
+                    size_t n = std::min(segment.size(), rest.size());
+                    if (!std::ranges::equal(segment.first(n), rest.first(n)))
+                        return false;
+                    segment = segment.subspan(n);
+                    rest = rest.subspan(n);
+                }
+            }
+            return true;
+        } else if constexpr (segmented_range<decltype(r1)> && std::ranges::sized_range<decltype(r2)>) {
+            if (std::ranges::size(r1) != std::ranges::size(r2))
+                return false;
+            auto it = std::ranges::begin(r2);
+            for (auto segment : r1.segments()) {
+                if (!std::ranges::equal(segment, std::ranges::subrange(it, std::ranges::next(it, segment.size()))))
+                    return false;
+                std::ranges::advance(it, segment.size());
+            }
+            return true;
+        } else if constexpr (segmented_range<decltype(r2)> && std::ranges::sized_range<decltype(r1)>)
+            return equal(r2, r1);
+        else
+            return std::ranges::equal(r1, r2);
+    }
+
+    /**
+     * @brief Apply `f` to the elements of `r` and write the results to `out`
+     * @return the output iterator past the last written element
+     */
+    def transform(std::ranges::input_range auto &&r, std::weakly_incrementable auto out, auto f) {
+        if constexpr (segmented_range<decltype(r)>) {
+            for (auto segment : r.segments())
+                out = std::ranges::transform(segment, std::move(out), f).out;
+            return out;
+        } else
+            return std::ranges::transform(r, std::move(out), f).out;
+    }
+
+}
+
 #undef def
 
 static_assert(std::random_access_iterator<StreamBuffer<int, 1>::iterator>, "StreamBuffer::iterator must be a random access iterator");
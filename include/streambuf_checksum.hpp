@@ -0,0 +1,251 @@
+#pragma once
+
+#include <streambuf.hpp>
+#include <array>
+#include <bit>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define STREAMBUF_CRC32C_SSE42
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define STREAMBUF_CRC32C_ARM
+#endif
+
+#define def constexpr auto
+
+/**
+ * @brief Checksums and hashes that run on each contiguous part of a `segmented_range`.
+ */
+namespace checksum {
+
+    /**
+     * @brief Call `f` with each contiguous part of `r` as `std::span<const std::byte>`
+     * @note Ranges that are neither segmented nor contiguous are visited element by element.
+     */
+    void for_each_bytes(std::ranges::input_range auto &&r, auto &&f) {
+        using T = std::ranges::range_value_t<decltype(r)>;
+        static_assert(std::is_trivially_copyable_v<T>, "checksum requires a trivially copyable value type");
+        if constexpr (segmented_range<decltype(r)>) {
+            for (auto segment : r.segments())
+                f(std::as_bytes(std::span(segment)));
+        } else if constexpr (std::ranges::contiguous_range<decltype(r)> && std::ranges::sized_range<decltype(r)>)
+            f(std::as_bytes(std::span(std::ranges::data(r), std::ranges::size(r))));
+        else
+            for (const T &element : r)
+                f(std::as_bytes(std::span(&element, 1)));
+    }
+
+    /**
+     * @brief A running CRC32C (Castagnoli)
+     * @note The SSE4.2 or ARMv8 CRC instructions are used when available, otherwise a lookup table.
+     */
+    class crc32c_state {
+        static constexpr std::uint32_t polynomial = 0x82F63B78; // reversed
+
+        static constexpr auto table = [] {
+            std::array<std::uint32_t, 256> table {};
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                std::uint32_t crc = i;
+                for (int k = 0; k < 8; ++k)
+                    crc = crc & 1 ? (crc >> 1) ^ polynomial : crc >> 1;
+                table[i] = crc;
+            }
+            return table;
+        }();
+
+        static std::uint32_t update_portable(std::uint32_t crc, std::span<const std::byte> bytes) noexcept {
+            for (auto byte : bytes)
+                crc = table[(crc ^ std::to_integer<std::uint32_t>(byte)) & 0xFF] ^ (crc >> 8);
+            return crc;
+        }
+
+#if defined(STREAMBUF_CRC32C_SSE42)
+        __attribute__((target("sse4.2")))
+        static std::uint32_t update_hardware(std::uint32_t crc, std::span<const std::byte> bytes) noexcept {
+            const std::byte *p = bytes.data(), *last = p + bytes.size();
+            std::uint64_t crc64 = crc;
+            for (; last - p >= 8; p += 8) {
+                std::uint64_t word;
+                std::memcpy(&word, p, 8);
+                crc64 = _mm_crc32_u64(crc64, word);
+            }
+            crc = static_cast<std::uint32_t>(crc64);
+            for (; p != last; ++p)
+                crc = _mm_crc32_u8(crc, std::to_integer<std::uint8_t>(*p));
+            return crc;
+        }
+        static bool has_hardware() noexcept {
+            static const bool supported = __builtin_cpu_supports("sse4.2");
+            return supported;
+        }
+#elif defined(STREAMBUF_CRC32C_ARM)
+        static std::uint32_t update_hardware(std::uint32_t crc, std::span<const std::byte> bytes) noexcept {
+            const std::byte *p = bytes.data(), *last = p + bytes.size();
+            for (; last - p >= 8; p += 8) {
+                std::uint64_t word;
+                std::memcpy(&word, p, 8);
+                crc = __crc32cd(crc, word);
+            }
+            for (; p != last; ++p)
+                crc = __crc32cb(crc, std::to_integer<std::uint8_t>(*p));
+            return crc;
+        }
+        static constexpr bool has_hardware() noexcept { return true; }
+#endif
+
+        std::uint32_t crc;
+
+    public:
+        /**
+         * @param initial the value of a previous checksum to continue from
+         */
+        constexpr crc32c_state(std::uint32_t initial = 0) noexcept : crc { ~initial } { }
+
+        /**
+         * @brief Feed some bytes
+         */
+        void update(std::span<const std::byte> bytes) noexcept {
+#if defined(STREAMBUF_CRC32C_SSE42) || defined(STREAMBUF_CRC32C_ARM)
+            if (has_hardware()) {
+                crc = update_hardware(crc, bytes);
+                return;
+            }
+#endif
+            crc = update_portable(crc, bytes);
+        }
+
+        /**
+         * @brief Feed the elements of a range
+         */
+        void update(std::ranges::input_range auto &&r) noexcept { for_each_bytes(r, [this](auto bytes) { update(bytes); }); }
+
+        /**
+         * @brief Get the checksum of everything fed so far
+         */
+        def value() const noexcept -> std::uint32_t { return ~crc; }
+    };
+
+    /**
+     * @brief A running 64-bit xxHash (XXH64)
+     */
+    class xxhash64_state {
+        static constexpr std::uint64_t prime1 = 11400714785074694791ULL;
+        static constexpr std::uint64_t prime2 = 14029467366897019727ULL;
+        static constexpr std::uint64_t prime3 = 1609587929392839161ULL;
+        static constexpr std::uint64_t prime4 = 9650029242287828579ULL;
+        static constexpr std::uint64_t prime5 = 2870177450012600261ULL;
+
+        static def round(std::uint64_t acc, std::uint64_t input) noexcept { return std::rotl(acc + input * prime2, 31) * prime1; }
+        static def merge(std::uint64_t acc, std::uint64_t value) noexcept { return (acc ^ round(0, value)) * prime1 + prime4; }
+        static std::uint64_t read64(const std::byte *p) noexcept { std::uint64_t v; std::memcpy(&v, p, 8); return v; }
+        static std::uint32_t read32(const std::byte *p) noexcept { std::uint32_t v; std::memcpy(&v, p, 4); return v; }
+
+        void consume(const std::byte *p) noexcept {
+            for (auto &acc : accs)
+                acc = round(acc, read64(p)), p += 8;
+        }
+
+        std::uint64_t seed;
+        std::array<std::uint64_t, 4> accs;
+        std::uint64_t length = 0;
+        std::array<std::byte, 32> pending {}; // the bytes not yet consumed by the accumulators
+        size_t pending_size = 0;
+
+    public:
+        constexpr xxhash64_state(std::uint64_t seed = 0) noexcept
+            : seed { seed }, accs { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 } { }
+
+        /**
+         * @brief Feed some bytes
+         */
+        void update(std::span<const std::byte> bytes) noexcept {
+            length += bytes.size();
+            const std::byte *p = bytes.data(), *last = p + bytes.size();
+            if (pending_size != 0) {
+                size_t n = std::min<size_t>(pending.size() - pending_size, last - p);
+                std::memcpy(pending.data() + pending_size, p, n);
+                pending_size += n, p += n;
+                if (pending_size < pending.size())
+                    return;
+                consume(pending.data());
+                pending_size = 0;
+            }
+            for (; last - p >= 32; p += 32)
+                consume(p);
+            std::memcpy(pending.data(), p, last - p);
+            pending_size = last - p;
+        }
+
+        /**
+         * @brief Feed the elements of a range
+         */
+        void update(std::ranges::input_range auto &&r) noexcept { for_each_bytes(r, [this](auto bytes) { update(bytes); }); }
+
+        /**
+         * @brief Get the hash of everything fed so far
+         */
+        std::uint64_t value() const noexcept {
+            std::uint64_t h;
+            if (length >= 32) {
+                h = std::rotl(accs[0], 1) + std::rotl(accs[1], 7) + std::rotl(accs[2], 12) + std::rotl(accs[3], 18);
+                for (auto acc : accs)
+                    h = merge(h, acc);
+            } else
+                h = seed + prime5;
+            h += length;
+            const std::byte *p = pending.data(), *last = p + pending_size;
+            for (; last - p >= 8; p += 8)
+                h = std::rotl(h ^ round(0, read64(p)), 27) * prime1 + prime4;
+            if (last - p >= 4)
+                h = std::rotl(h ^ read32(p) * prime1, 23) * prime2 + prime3, p += 4;
+            for (; p != last; ++p)
+                h = std::rotl(h ^ std::to_integer<std::uint64_t>(*p) * prime5, 11) * prime1;
+            h = (h ^ (h >> 33)) * prime2;
+            h = (h ^ (h >> 29)) * prime3;
+            return h ^ (h >> 32);
+        }
+    };
+
+    /**
+     * @brief Compute the CRC32C of a range
+     * @param initial the value of a previous checksum to continue from
+     */
+    std::uint32_t crc32c(std::ranges::input_range auto &&r, std::uint32_t initial = 0) noexcept {
+        crc32c_state state { initial };
+        state.update(r);
+        return state.value();
+    }
+
+    /**
+     * @brief Compute the 64-bit xxHash of a range
+     */
+    std::uint64_t hash(std::ranges::input_range auto &&r, std::uint64_t seed = 0) noexcept {
+        xxhash64_state state { seed };
+        state.update(r);
+        return state.value();
+    }
+
+    /**
+     * @brief A view that feeds its elements to a checksum state right before they are committed or consumed.
+     * @note The data is still in cache when the producer commits, so no second pass over memory is needed later.
+     * @tparam V `write_view` or `read_view`
+     * @tparam State `crc32c_state`, `xxhash64_state` or any type with `update(range)`
+     */
+    template<class V, class State>
+    struct checksummed : view_interface<checksummed<V, State>> {
+        checksummed(V &&view, State &state) noexcept : view { std::move(view) }, state { state } { }
+        checksummed(const checksummed &) = delete;
+        checksummed &operator=(const checksummed &) = delete;
+        ~checksummed() { state.update(view); }
+        def begin() const noexcept { return view.begin(); }
+        def end() const noexcept { return view.end(); }
+        def segments() const noexcept { return view.segments(); }
+    private:
+        V view;
+        State &state;
+    };
+
+}
+
+#undef def
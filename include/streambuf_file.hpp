@@ -0,0 +1,801 @@
+#pragma once
+
+#include <streambuf.hpp>
+#include <cerrno>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(STREAMBUF_USE_LIBURING)
+#include <liburing.h>
+#endif
+
+/**
+ * @brief A storage that lives in a memory-mapped file, so that the committed data survives a crash or a restart.
+ * @note The file starts with a header holding the capacity, the element size and the committed
+ *       and consumed positions, which `StreamBuffer` updates whenever a view is committed or consumed.
+ *       Reopening the file recovers the data committed and not yet consumed without any copy.
+ *       The data lent in views is lost.
+ * @note A crashed process leaves its writes in the page cache. To survive a power loss as well,
+ *       the file is written to disk with `msync` after every `sync_batch` committed elements,
+ *       or with `StreamBuffer::sync()`.
+ * @tparam T the element type, which must be trivially copyable
+ * @tparam N the number of elements
+ */
+template<typename T, size_t N>
+class mapped_storage {
+    static_assert(std::is_trivially_copyable_v<T>, "mapped_storage requires a trivially copyable value type");
+    static_assert(alignof(T) <= 4096, "mapped_storage supports alignments up to a page");
+
+    struct header {
+        std::uint64_t magic;
+        std::uint64_t capacity;
+        std::uint64_t element_size;
+        std::uint64_t consumed;     // the start of the data not yet consumed
+        std::uint64_t committed;    // the end of the committed data
+    };
+    static constexpr std::uint64_t magic = 0x5354524d42554631; // "STRMBUF1"
+    static constexpr size_t data_offset = 4096;
+    static constexpr size_t mapping_size = data_offset + N * sizeof(T);
+
+    header *head;
+    T *elements;
+    size_t sync_batch;
+    size_t synced = 0;  // the committed position at the last automatic sync
+
+    static std::uint64_t load(const std::uint64_t &field) noexcept { return std::atomic_ref(const_cast<std::uint64_t &>(field)).load(std::memory_order_acquire); }
+    static void store(std::uint64_t &field, std::uint64_t value) noexcept { std::atomic_ref(field).store(value, std::memory_order_release); }
+
+public:
+    static constexpr bool is_persistent = true;
+
+    /**
+     * @param path the file, which is created if it does not exist
+     * @param sync_batch the number of committed elements after which the file is written to disk, 0 to never.
+     *        It is clamped to `N - 1`, since the distance to the last synced position is measured in the ring.
+     * @throw std::system_error if the file cannot be opened or mapped
+     * @throw std::runtime_error if the file was created for another capacity or element type
+     */
+    explicit mapped_storage(const char *path, size_t sync_batch = 0) : sync_batch { std::min(sync_batch, N - 1) } {
+        int fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), "open");
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (st.st_size == 0 && ftruncate(fd, mapping_size) != 0)) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::system_category(), "ftruncate");
+        }
+        if (st.st_size != 0 && static_cast<size_t>(st.st_size) != mapping_size) {
+            ::close(fd);
+            throw std::runtime_error("mapped storage does not match the buffer");
+        }
+        void *memory = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        ::close(fd);
+        if (memory == MAP_FAILED)
+            throw std::system_error(error, std::system_category(), "mmap");
+        head = static_cast<header *>(memory);
+        elements = reinterpret_cast<T *>(static_cast<std::byte *>(memory) + data_offset);
+        if (head->magic == 0) {
+            *head = { 0, N, sizeof(T), 0, 0 };
+            store(head->magic, magic);
+        } else if (head->magic != magic || head->capacity != N || head->element_size != sizeof(T) || head->consumed >= N || head->committed >= N) {
+            munmap(memory, mapping_size);
+            throw std::runtime_error("mapped storage does not match the buffer");
+        }
+        synced = head->committed;
+    }
+    mapped_storage(const mapped_storage &) = delete;
+    mapped_storage &operator=(const mapped_storage &) = delete;
+    ~mapped_storage() {
+        if (sync_batch != 0)
+            msync(head, mapping_size, MS_SYNC);
+        munmap(head, mapping_size);
+    }
+
+    T *data() noexcept { return elements; }
+    const T *data() const noexcept { return elements; }
+    T *begin() noexcept { return elements; }
+    const T *begin() const noexcept { return elements; }
+    T *end() noexcept { return elements + N; }
+    const T *end() const noexcept { return elements + N; }
+    constexpr size_t size() const noexcept { return N; }
+    T &operator[](size_t index) noexcept { return elements[index]; }
+    const T &operator[](size_t index) const noexcept { return elements[index]; }
+
+    /**
+     * @brief Get the consumed and committed positions recovered from the file
+     */
+    std::pair<size_t, size_t> positions() const noexcept { return { load(head->consumed), load(head->committed) }; }
+
+    /**
+     * @brief Record the end of the committed data, called under the lock of the write manager
+     */
+    void store_committed(size_t stop) noexcept {
+        store(head->committed, stop);
+        if (sync_batch != 0 && (stop + N - synced) % N >= sync_batch) {
+            msync(head, mapping_size, MS_SYNC);
+            synced = stop;
+        }
+    }
+
+    /**
+     * @brief Record the start of the data not yet consumed, called under the lock of the read manager
+     */
+    void store_consumed(size_t start) noexcept { store(head->consumed, start); }
+
+    /**
+     * @brief Write the data and the positions to disk
+     * @throw std::system_error if the data cannot be written
+     */
+    void sync() {
+        if (msync(head, mapping_size, MS_SYNC) != 0)
+            throw std::system_error(errno, std::system_category(), "msync");
+    }
+};
+
+/**
+ * @brief Get the part of some segments after their first `skip` bytes
+ * @return the remaining segments and their number
+ */
+inline std::pair<std::array<iovec, 2>, int> iov_suffix(const std::array<iovec, 2> &iov, int count, size_t skip) noexcept {
+    std::array<iovec, 2> rest;
+    int n = 0;
+    for (int i = 0; i < count; ++i) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        rest[n++] = { static_cast<char *>(iov[i].iov_base) + skip, iov[i].iov_len - skip };
+        skip = 0;
+    }
+    return { rest, n };
+}
+
+/**
+ * @brief A sink that writes the committed data of a buffer to a local file.
+ * @note Each submission lends a `read_view` and writes its segments with one vectored write,
+ *       so nothing is copied. The view is returned to the buffer only when its write completes,
+ *       and up to `depth` writes are in flight at once when io_uring is used (`STREAMBUF_USE_LIBURING`).
+ *       Otherwise each submission is written synchronously with `pwritev`.
+ * @tparam B the buffer type, whose elements must be trivially copyable
+ */
+template<class B>
+class FileSink {
+    using value_type = std::ranges::range_value_t<B>;
+    using read_view = typename B::read_view;
+    static_assert(std::is_trivially_copyable_v<value_type>, "FileSink requires a trivially copyable value type");
+
+    struct slot {
+        size_t index;                       // the position of this slot in `slots`
+        std::optional<read_view> view;      // the view being written, returned at completion
+        std::array<iovec, 2> iov;           // the segments of the view
+        int count;                          // the number of segments
+        off_t offset;                       // the offset in the file
+        size_t bytes;                       // the size of the write
+    };
+
+    B &buffer;
+    int fd;
+    off_t offset;
+    std::vector<slot> slots;
+    std::vector<size_t> idle;   // the indices of the slots not in flight
+#if defined(STREAMBUF_USE_LIBURING)
+    io_uring ring;
+#endif
+
+    /**
+     * @brief Write the part of a slot not yet written, retrying short writes
+     * @param written the number of bytes already written
+     * @throw std::system_error if the write fails
+     */
+    void write_remaining(const slot &s, size_t written) {
+        while (written < s.bytes) {
+            auto [rest, count] = iov_suffix(s.iov, s.count, written);
+            ssize_t result = pwritev(fd, rest.data(), count, s.offset + written);
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result <= 0)
+                throw std::system_error(result < 0 ? errno : EIO, std::system_category(), "pwritev");
+            written += result;
+        }
+    }
+
+    /**
+     * @brief Finish the write of a slot and return its view to the buffer
+     * @param result the number of bytes written, or a negative error number
+     * @return the number of bytes written
+     * @throw std::system_error if the write failed, the view stays lent
+     */
+    size_t finish(slot &s, long result) {
+        if (result < 0)
+            throw std::system_error(static_cast<int>(-result), std::system_category(), "write");
+        write_remaining(s, result);
+        s.view.reset();
+        idle.push_back(s.index);
+        return s.bytes;
+    }
+
+    /**
+     * @brief Handle a write that failed at completion
+     * @note The other writes in flight are completed first, since only the last lent view can be given back.
+     *       The writes submitted before the first failure are finished, and the views of the others are
+     *       given back newest first, so that their data is submitted again from the offset of the failure.
+     * @throw std::system_error the error of the first failed write
+     */
+    [[noreturn]] void rewind(slot &failed, std::system_error error) {
+        std::vector<std::pair<slot *, long>> lent { { &failed, 0 } };
+#if defined(STREAMBUF_USE_LIBURING)
+        while (lent.size() < in_flight()) {
+            io_uring_cqe *cqe;
+            if (int e = io_uring_wait_cqe(&ring, &cqe); e == -EINTR)
+                continue;
+            else if (e < 0)
+                break;
+            slot *s = static_cast<slot *>(io_uring_cqe_get_data(cqe));
+            long result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            if (s != nullptr)
+                lent.emplace_back(s, result);
+        }
+#endif
+        std::ranges::sort(lent, std::less<>(), [](const auto &l) { return l.first->offset; });
+        auto first = lent.begin();
+        for (; first->first != &failed; ++first)
+            try { finish(*first->first, first->second); }
+            catch (std::system_error &e) {
+                error = e;
+                break;
+            }
+        for (auto last = lent.end(); last != first;)
+            abandon(*(--last)->first);
+        throw error;
+    }
+
+    /**
+     * @brief Give back the view of a slot that could not be written, so that its data is submitted again
+     * @note The data is lost only if a later view was lent by another reader in the meantime.
+     */
+    void abandon(slot &s) noexcept {
+        try {
+            s.view->give_back();
+            offset = s.offset;
+        } catch (std::logic_error &) { }
+        s.view.reset();
+        idle.push_back(s.index);
+    }
+
+public:
+    /**
+     * @param buffer the buffer to drain
+     * @param fd the file to write, which is not closed by the sink
+     * @param offset the offset in the file to start writing at
+     * @param depth the maximum number of writes in flight
+     * @throw std::system_error if io_uring cannot be initialized
+     */
+    FileSink(B &buffer, int fd, off_t offset = 0, unsigned depth = 8) : buffer { buffer }, fd { fd }, offset { offset }, slots(depth) {
+        for (size_t i = depth; i-- > 0;) {
+            slots[i].index = i;
+            idle.push_back(i);
+        }
+#if defined(STREAMBUF_USE_LIBURING)
+        if (int error = io_uring_queue_init(depth, &ring, 0); error < 0)
+            throw std::system_error(-error, std::system_category(), "io_uring_queue_init");
+#endif
+    }
+    FileSink(const FileSink &) = delete;
+    FileSink &operator=(const FileSink &) = delete;
+    ~FileSink() {
+        try {
+            while (in_flight() > 0)
+                complete(true);
+        } catch (std::system_error &) { }
+#if defined(STREAMBUF_USE_LIBURING)
+        io_uring_queue_exit(&ring);
+#endif
+    }
+
+    /**
+     * @brief Get the number of writes in flight
+     */
+    size_t in_flight() const noexcept { return slots.size() - idle.size(); }
+
+    /**
+     * @brief Get the offset in the file where the next submission will be written
+     */
+    off_t position() const noexcept { return offset; }
+
+    /**
+     * @brief Submit the committed data of the buffer
+     * @param max the maximum number of elements to submit
+     * @return the number of elements submitted
+     * @note This function waits for a completion if `depth` writes are already in flight.
+     * @throw std::system_error if a write fails. If it could not be submitted, its data stays
+     *        in the buffer and `position()` is not advanced, so the next call submits it again.
+     */
+    size_t submit(size_t max = std::numeric_limits<size_t>::max()) {
+        size_t n = std::min(max, buffer.size());
+        if (n == 0)
+            return 0;
+        while (idle.empty())
+            complete(true);
+        slot &s = slots[idle.back()];
+        idle.pop_back();
+        s.view.emplace(buffer.read(n));
+        s.count = 0;
+        for (auto segment : s.view->segments())
+            if (!segment.empty())
+                s.iov[s.count++] = { static_cast<void *>(segment.data()), segment.size_bytes() };
+        s.offset = offset;
+        s.bytes = n * sizeof(value_type);
+        offset += s.bytes;
+        try {
+#if defined(STREAMBUF_USE_LIBURING)
+            io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+            if (sqe == nullptr)
+                throw std::system_error(EBUSY, std::system_category(), "io_uring_get_sqe");
+            io_uring_prep_writev(sqe, fd, s.iov.data(), s.count, s.offset);
+            io_uring_sqe_set_data(sqe, &s);
+            if (int error = io_uring_submit(&ring); error < 0) {
+                // the entry stays queued and may be submitted later, so it must not touch the view
+                io_uring_prep_nop(sqe);
+                io_uring_sqe_set_data(sqe, nullptr);
+                throw std::system_error(-error, std::system_category(), "io_uring_submit");
+            }
+#else
+            write_remaining(s, 0);
+#endif
+        } catch (std::system_error &) {
+            abandon(s);
+            throw;
+        }
+#if !defined(STREAMBUF_USE_LIBURING)
+        finish(s, s.bytes);
+#endif
+        return n;
+    }
+
+    /**
+     * @brief Return the views whose writes have completed to the buffer
+     * @param wait whether to block until at least one write completes
+     * @return the number of bytes completed
+     * @throw std::system_error if a write fails, its data and that of the later writes stay in the buffer
+     *        and `position()` is rolled back, see `rewind()`
+     */
+    size_t complete(bool wait = false) {
+        size_t bytes = 0;
+#if defined(STREAMBUF_USE_LIBURING)
+        while (in_flight() > 0) {
+            io_uring_cqe *cqe;
+            int error = wait && bytes == 0 ? io_uring_wait_cqe(&ring, &cqe) : io_uring_peek_cqe(&ring, &cqe);
+            if (error == -EINTR)
+                continue;
+            if (error == -EAGAIN)
+                break;
+            if (error < 0)
+                throw std::system_error(-error, std::system_category(), "io_uring_wait_cqe");
+            slot *s = static_cast<slot *>(io_uring_cqe_get_data(cqe));
+            int result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            if (s == nullptr)
+                continue;
+            try { bytes += finish(*s, result); }
+            catch (std::system_error &error) { rewind(*s, error); }
+        }
+#else
+        (void)wait;
+#endif
+        return bytes;
+    }
+
+    /**
+     * @brief Submit the committed data and wait until every write completes
+     * @throw std::system_error if a write fails
+     */
+    void flush() {
+        submit();
+        while (in_flight() > 0)
+            complete(true);
+    }
+};
+
+/**
+ * @brief A source that fills a buffer from a file, a pipe or a FIFO.
+ * @note Each submission prepares a `write_view` of `chunk` elements and reads into its segments
+ *       with one vectored read, so nothing is copied. Only the elements actually read are committed.
+ *       With io_uring (`STREAMBUF_USE_LIBURING`) up to `depth` reads of a regular file are in flight
+ *       at once, and are committed in order. Pipes and FIFOs are read one submission at a time.
+ *       Otherwise each submission is read synchronously with `readv` or `preadv`.
+ * @note At the end of the file or at the first error, the buffer is closed once every read is committed,
+ *       so the consumers of `async_read()` see the end of the stream.
+ * @tparam B the buffer type, whose elements must be trivially copyable
+ */
+template<class B>
+class FileSource {
+    using value_type = std::ranges::range_value_t<B>;
+    using write_view = typename B::write_view;
+    static_assert(std::is_trivially_copyable_v<value_type>, "FileSource requires a trivially copyable value type");
+
+    struct slot {
+        std::optional<write_view> view;     // the view being read into, committed at completion
+        std::array<iovec, 2> iov;           // the segments of the view
+        int count;                          // the number of segments
+        off_t offset;                       // the offset in the file, or -1 to read at the current position
+        size_t capacity;                    // the size of the view in bytes
+        size_t bytes;                       // the number of bytes read
+        bool done;                          // whether the read has completed
+    };
+
+    B &buffer;
+    int fd;
+    off_t offset;
+    size_t chunk;
+    std::vector<slot> slots;
+    std::vector<size_t> idle;   // the indices of the slots not in flight
+    std::deque<size_t> pending; // the indices of the slots in flight, in the order of submission
+    size_t ready = 0;           // the number of elements committed and not yet reported
+    bool end = false;           // whether the end of the file has been reached
+    int failure = 0;            // the error number of a failed read, thrown once every read in flight is committed
+#if defined(STREAMBUF_USE_LIBURING)
+    io_uring ring;
+#endif
+
+    /**
+     * @brief Read into the part of a slot not yet filled
+     * @return the number of bytes read, 0 at the end of the file, or a negative error number
+     */
+    long read_some(slot &s) noexcept {
+        auto [rest, count] = iov_suffix(s.iov, s.count, s.bytes);
+        while (true) {
+            ssize_t result = s.offset < 0 ? readv(fd, rest.data(), count) : preadv(fd, rest.data(), count, s.offset + s.bytes);
+            if (result >= 0 || errno != EINTR)
+                return result >= 0 ? result : -errno;
+        }
+    }
+
+    /**
+     * @brief Complete the read of a slot
+     * @param result the number of bytes read, or a negative error number
+     * @note A read that stops inside an element is continued until the element is whole.
+     *       A regular file is read until the slot is full, so that only the last read is short.
+     *       The source stops at the end of the file or at the first error, which `commit()` throws.
+     */
+    void finish(slot &s, long result) noexcept {
+        s.done = true;
+        if (result > 0) {
+            s.bytes += result;
+            while (s.bytes < s.capacity && (s.bytes % sizeof(value_type) != 0 || s.offset >= 0) && (result = read_some(s)) > 0)
+                s.bytes += result;
+        }
+        if (result <= 0)
+            end = true;
+        if (result < 0 && failure == 0)
+            failure = static_cast<int>(-result);
+    }
+
+    /**
+     * @brief Commit the completed reads in the order of submission
+     * @note A short read gives back the rest of its view, and the views after it are emptied.
+     *       Since only the last lent view can shrink, this is done from the last view
+     *       once every read in flight has completed.
+     * @note The buffer is closed once the end of the file or an error is reached and every read is committed.
+     * @throw std::system_error if a read failed, once every read in flight has completed and is committed
+     */
+    void commit() {
+        bool all_done = std::ranges::all_of(pending, [this](size_t i) { return slots[i].done; });
+        if (all_done) {
+            auto short_read = std::ranges::find_if(pending, [this](size_t i) { return slots[i].bytes < slots[i].capacity; });
+            for (auto it = pending.end(); short_read != pending.end() && it-- != short_read;)
+                slots[*it].view->shrink(it == short_read ? slots[*it].bytes / sizeof(value_type) : 0);
+        }
+        while (!pending.empty()) {
+            slot &s = slots[pending.front()];
+            if (!s.done || (s.bytes < s.capacity && !all_done))
+                break;
+            ready += s.view->size();
+            s.view.reset();
+            idle.push_back(pending.front());
+            pending.pop_front();
+        }
+        if constexpr (requires { buffer.close(); })
+            if (end && pending.empty() && !buffer.closed())
+                buffer.close();
+        if (failure != 0 && pending.empty())
+            throw std::system_error(std::exchange(failure, 0), std::system_category(), "read");
+    }
+
+public:
+    /**
+     * @param buffer the buffer to fill
+     * @param fd the file to read, which is not closed by the source
+     * @param offset the offset in the file to start reading at, or -1 for a pipe or a FIFO
+     * @param chunk the number of elements to read at once, at most `buffer.max_size()`
+     * @param depth the maximum number of reads in flight
+     * @throw std::system_error if io_uring cannot be initialized
+     */
+    FileSource(B &buffer, int fd, off_t offset = -1, size_t chunk = 4096, unsigned depth = 4)
+        : buffer { buffer }, fd { fd }, offset { offset }, chunk { chunk }, slots(offset < 0 ? 1 : depth) {
+        for (size_t i = slots.size(); i-- > 0;)
+            idle.push_back(i);
+#if defined(STREAMBUF_USE_LIBURING)
+        if (int error = io_uring_queue_init(slots.size(), &ring, 0); error < 0)
+            throw std::system_error(-error, std::system_category(), "io_uring_queue_init");
+#endif
+    }
+    FileSource(const FileSource &) = delete;
+    FileSource &operator=(const FileSource &) = delete;
+    ~FileSource() {
+        try {
+            while (!pending.empty())
+                complete(true);
+        } catch (std::system_error &) { }
+#if defined(STREAMBUF_USE_LIBURING)
+        io_uring_queue_exit(&ring);
+#endif
+    }
+
+    /**
+     * @brief Check if the end of the file has been reached and every read has been committed
+     */
+    bool eof() const noexcept { return end && pending.empty(); }
+
+    /**
+     * @brief Get the number of reads in flight
+     */
+    size_t in_flight() const noexcept { return pending.size(); }
+
+    /**
+     * @brief Start reads until `depth` reads are in flight or the buffer has no space for a chunk
+     * @return the number of reads started
+     * @throw std::system_error if a read fails
+     */
+    size_t submit() {
+        size_t started = 0;
+        while (!end && !idle.empty()) {
+            slot &s = slots[idle.back()];
+            try { s.view.emplace(buffer.prepare(chunk)); }
+            catch (std::out_of_range &) { break; }
+            idle.pop_back();
+            pending.push_back(&s - slots.data());
+            s.count = 0;
+            for (auto segment : s.view->segments())
+                if (!segment.empty())
+                    s.iov[s.count++] = { static_cast<void *>(segment.data()), segment.size_bytes() };
+            s.offset = offset;
+            s.capacity = chunk * sizeof(value_type);
+            s.bytes = 0;
+            s.done = false;
+            if (offset >= 0)
+                offset += s.capacity;
+            ++started;
+#if defined(STREAMBUF_USE_LIBURING)
+            io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+            if (sqe == nullptr) {
+                // no entry is free until the pending ones are submitted, so retry in the next call
+                s.view->shrink(0);
+                s.view.reset();
+                pending.pop_back();
+                idle.push_back(&s - slots.data());
+                if (offset >= 0)
+                    offset -= s.capacity;
+                --started;
+                break;
+            }
+            io_uring_prep_readv(sqe, fd, s.iov.data(), s.count, s.offset);
+            io_uring_sqe_set_data(sqe, &s);
+            if (int error = io_uring_submit(&ring); error < 0) {
+                // the entry stays queued and may be submitted later, so it must not touch the view
+                io_uring_prep_nop(sqe);
+                io_uring_sqe_set_data(sqe, nullptr);
+                finish(s, error);
+                commit();
+            }
+#else
+            finish(s, read_some(s));
+            commit();
+#endif
+        }
+        return started;
+    }
+
+    /**
+     * @brief Commit the reads that have completed
+     * @param wait whether to block until at least one read completes
+     * @return the number of elements committed since the last call
+     * @throw std::system_error if a read fails
+     */
+    size_t complete(bool wait = false) {
+#if defined(STREAMBUF_USE_LIBURING)
+        for (bool completed = false; std::ranges::any_of(pending, [this](size_t i) { return !slots[i].done; });) {
+            io_uring_cqe *cqe;
+            int error = wait && !completed ? io_uring_wait_cqe(&ring, &cqe) : io_uring_peek_cqe(&ring, &cqe);
+            if (error == -EINTR)
+                continue;
+            if (error == -EAGAIN)
+                break;
+            if (error < 0)
+                throw std::system_error(-error, std::system_category(), "io_uring_wait_cqe");
+            slot *s = static_cast<slot *>(io_uring_cqe_get_data(cqe));
+            int result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            if (s == nullptr)
+                continue;
+            completed = true;
+            finish(*s, result);
+        }
+#else
+        (void)wait;
+#endif
+        commit();
+        return std::exchange(ready, 0);
+    }
+
+    /**
+     * @brief Start reads and commit at least one of them
+     * @return the number of elements committed, 0 at the end of the file or if the buffer has no space
+     * @throw std::system_error if a read fails
+     */
+    size_t fill() {
+        submit();
+        return complete(true);
+    }
+};
+
+/**
+ * @brief A buffer that spills to a local file instead of blocking the producer when it is full.
+ * @note When `prepare()` finds no space, the committed data of the in-memory buffer is appended
+ *       to the file with one vectored write, which frees the space. Readers drain the file before
+ *       the memory, so the order of the data is kept: the file is reloaded into a second buffer of
+ *       type `B` with one vectored read, and its views are handed out like those of the memory.
+ *       The file is reused from its beginning whenever it has been drained.
+ * @note Several producers may prepare concurrently, but only one consumer may read.
+ * @tparam B the buffer type, whose elements must be trivially copyable
+ */
+template<class B>
+class SpillBuffer {
+    using value_type = std::ranges::range_value_t<B>;
+    using write_view = typename B::write_view;
+    using read_view = typename B::read_view;
+    static_assert(std::is_trivially_copyable_v<value_type>, "SpillBuffer requires a trivially copyable value type");
+
+    B memory {};                // the newest data
+    B reload {};                // the oldest data, reloaded from the file
+    int fd;
+    std::atomic<off_t> read_offset = 0;     // the offset of the oldest data in the file
+    std::atomic<off_t> write_offset = 0;    // the end of the data in the file
+    std::mutex mutex {};        // the mutex to protect the file and the choice of the tier to read
+
+    /**
+     * @brief Get the segments of a view as `iovec`s
+     */
+    static std::pair<std::array<iovec, 2>, int> segments_of(const auto &view) noexcept {
+        std::array<iovec, 2> iov;
+        int count = 0;
+        for (auto segment : view.segments())
+            if (!segment.empty())
+                iov[count++] = { static_cast<void *>(segment.data()), segment.size_bytes() };
+        return { iov, count };
+    }
+
+    /**
+     * @brief Transfer all bytes of some segments at an offset of the file
+     * @param transfer `preadv` or `pwritev`
+     * @throw std::system_error if the transfer fails or the file ends
+     */
+    void transfer_all(auto transfer, const std::array<iovec, 2> &iov, int count, off_t offset, size_t bytes) {
+        for (size_t done = 0; done < bytes;) {
+            auto [rest, n] = iov_suffix(iov, count, done);
+            ssize_t result = transfer(fd, rest.data(), n, offset + done);
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result <= 0)
+                throw std::system_error(result < 0 ? errno : EIO, std::system_category(), "spill");
+            done += result;
+        }
+    }
+
+    /**
+     * @brief Reload the oldest data of the file into `reload`
+     * @note `mutex` must be locked.
+     */
+    void refill() {
+        size_t n = std::min<size_t>((write_offset - read_offset) / sizeof(value_type), reload.space());
+        if (n == 0)
+            return;
+        auto view = reload.prepare(n);
+        auto [iov, count] = segments_of(view);
+        try {
+            transfer_all(preadv, iov, count, read_offset, n * sizeof(value_type));
+        } catch (...) {
+            view.shrink(0);
+            throw;
+        }
+        read_offset += n * sizeof(value_type);
+        if (read_offset == write_offset)
+            read_offset = write_offset = 0;
+    }
+
+public:
+    /**
+     * @param fd the file to spill to, which is not closed by the buffer
+     */
+    explicit SpillBuffer(int fd) noexcept : fd { fd } { }
+    SpillBuffer(const SpillBuffer &) = delete;
+    SpillBuffer &operator=(const SpillBuffer &) = delete;
+
+    /**
+     * @brief Get the size of the data in memory
+     */
+    size_t memory_size() const noexcept { return memory.size(); }
+
+    /**
+     * @brief Get the size of the data spilled to the file and not yet read, including the reloaded data
+     */
+    size_t spilled_size() const noexcept { return reload.size() + (write_offset - read_offset) / sizeof(value_type); }
+
+    /**
+     * @brief Get the size of the data in both tiers
+     */
+    size_t size() const noexcept { return memory_size() + spilled_size(); }
+
+    /**
+     * @brief Check if both tiers are empty
+     */
+    bool empty() const noexcept { return size() == 0; }
+
+    /**
+     * @brief Append the committed data in memory to the file
+     * @return the number of elements spilled
+     * @throw std::system_error if the file cannot be written, the data stays in memory
+     */
+    size_t spill() {
+        std::lock_guard lock(mutex);
+        auto view = memory.read();
+        auto [iov, count] = segments_of(view);
+        size_t bytes = view.size() * sizeof(value_type);
+        try {
+            transfer_all(pwritev, iov, count, write_offset, bytes);
+        } catch (...) {
+            view.give_back();
+            throw;
+        }
+        write_offset += bytes;
+        return view.size();
+    }
+
+    /**
+     * @brief Prepare a space for writing, spilling the data in memory to the file if it is full
+     * @param n the size to prepare
+     * @return a view for writing
+     * @throw std::out_of_range if `n` is larger than `max_size()` or the space is still held by lent views
+     * @throw std::system_error if the file cannot be written
+     */
+    write_view prepare(size_t n) {
+        try { return memory.prepare(n); }
+        catch (std::out_of_range &) { }
+        spill();
+        return memory.prepare(n);
+    }
+
+    /**
+     * @brief Read the oldest data, from the file first and then from memory
+     * @param max the maximum size to read
+     * @return a view for reading, which is empty if no data is available
+     * @throw std::system_error if the file cannot be read
+     */
+    read_view read(size_t max = std::numeric_limits<size_t>::max()) {
+        std::lock_guard lock(mutex);
+        if (reload.empty())
+            refill();
+        B &tier = reload.empty() ? memory : reload;
+        return tier.read(std::min(max, tier.size()));
+    }
+};
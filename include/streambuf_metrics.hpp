@@ -0,0 +1,215 @@
+#pragma once
+
+#include <streambuf.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A registry of buffers whose statistics are rendered in the Prometheus text exposition format.
+ * @note Rendering only calls `StreamBuffer::stats()`, which reads relaxed atomics, so scraping never takes
+ *       the locks of a buffer. The registry has its own mutex, held while the snapshots are taken.
+ * @note The metrics are 0 unless `STREAMBUF_ENABLE_STATS` is defined.
+ * @note A buffer must be removed before it is destroyed.
+ */
+class MetricsRegistry {
+public:
+    using labels = std::vector<std::pair<std::string, std::string>>;
+
+private:
+    struct entry {
+        const void *buffer;
+        std::string labels;     // rendered, such as `buffer="frames",stage="decode"`
+        std::function<buffer_stats()> stats;
+    };
+
+    struct counter {
+        const char *name;
+        const char *help;
+        std::uint64_t buffer_stats::manager::*field;
+    };
+
+    struct histogram {
+        const char *name;
+        const char *help;
+        stat_histogram::counts buffer_stats::manager::*field;
+        std::uint64_t buffer_stats::manager::*sum;  // the exact sum in nanoseconds, if counted
+    };
+
+    static constexpr counter counters[] = {
+        { "lends_total", "The number of views lent.", &buffer_stats::manager::lends },
+        { "returns_total", "The number of views returned.", &buffer_stats::manager::returns },
+        { "lend_failures_total", "The number of lends that failed for lack of space or data.", &buffer_stats::manager::failures },
+        { "elements_total", "The number of elements committed or consumed.", &buffer_stats::manager::elements },
+        { "waits_total", "The number of asynchronous waits for space or data.", &buffer_stats::manager::waits },
+        { "wakeups_total", "The number of asynchronous waits that resumed.", &buffer_stats::manager::wakeups },
+        { "lock_acquisitions_total", "The number of times the mutex was locked.", &buffer_stats::manager::acquisitions },
+        { "lock_contended_total", "The number of times the mutex was locked after waiting for another thread.", &buffer_stats::manager::contended },
+    };
+
+    static constexpr histogram histograms[] = {
+        { "lock_wait_seconds", "The time each contended acquisition of the mutex waited.", &buffer_stats::manager::lock_wait, &buffer_stats::manager::lock_wait_ns },
+        { "lock_hold_seconds", "The time each acquisition held the mutex.", &buffer_stats::manager::lock_hold, &buffer_stats::manager::lock_hold_ns },
+        { "view_hold_seconds", "The time from lending each view to returning it.", &buffer_stats::manager::view_hold, nullptr },
+    };
+
+    static void check_name(std::string_view name) {
+        auto head = [](char c) { return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); };
+        auto tail = [&](char c) { return head(c) || (c >= '0' && c <= '9'); };
+        if (name.empty() || !head(name.front()) || !std::ranges::all_of(name.substr(1), tail))
+            throw std::invalid_argument("invalid metric or label name");
+    }
+
+    static void append_label(std::string &out, std::string_view name, std::string_view value) {
+        if (!out.empty())
+            out += ',';
+        out.append(name).append("=\"");
+        for (char c : value)
+            switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            default: out += c;
+            }
+        out += '"';
+    }
+
+    /**
+     * @brief Write the `# HELP` and `# TYPE` lines of a metric family
+     */
+    void family(std::string &out, std::string_view name, std::string_view help, std::string_view type) const {
+        std::format_to(std::back_inserter(out), "# HELP {}_{} {}\n# TYPE {}_{} {}\n", prefix, name, help, prefix, name, type);
+    }
+
+    /**
+     * @brief Write the samples of a histogram of nanoseconds in seconds
+     * @param sum the sum of the values in nanoseconds, or -1 to estimate it from the buckets
+     * @note A bucket is written at each power of two, whatever the counts, since Prometheus expects
+     *       the same `le` labels in every scrape to compute rates and quantiles.
+     */
+    void samples(std::string &out, std::string_view name, const std::string &labels, const stat_histogram::counts &counts, double sum) const {
+        std::uint64_t total = 0;
+        double estimate = 0;
+        for (size_t i = 0; i < stat_histogram::bucket_count; ++i) {
+            total += counts.buckets[i];
+            estimate += double(counts.buckets[i]) * stat_histogram::lower_bound(i);
+            if (i + 1 < stat_histogram::bucket_count && std::has_single_bit(stat_histogram::lower_bound(i + 1)))
+                std::format_to(std::back_inserter(out), "{}_{}_bucket{{{},le=\"{}\"}} {}\n",
+                    prefix, name, labels, stat_histogram::lower_bound(i + 1) / 1e9, total);
+        }
+        std::format_to(std::back_inserter(out), "{}_{}_bucket{{{},le=\"+Inf\"}} {}\n", prefix, name, labels, total);
+        std::format_to(std::back_inserter(out), "{}_{}_sum{{{}}} {}\n", prefix, name, labels, (sum < 0 ? estimate : sum) / 1e9);
+        std::format_to(std::back_inserter(out), "{}_{}_count{{{}}} {}\n", prefix, name, labels, total);
+    }
+
+    std::string prefix;
+    mutable std::mutex mutex;
+    std::vector<entry> entries;
+
+public:
+    /**
+     * @param prefix the prefix of every metric name
+     * @throw std::invalid_argument if the prefix is not a valid metric name
+     */
+    explicit MetricsRegistry(std::string prefix = "streambuf") : prefix { std::move(prefix) } { check_name(this->prefix); }
+
+    /**
+     * @brief Register a buffer
+     * @param buffer the buffer, which must outlive its registration
+     * @param name the value of the `buffer` label
+     * @param extra more labels to attach to every metric of the buffer
+     * @throw std::invalid_argument if a label name is invalid
+     */
+    template<class B>
+    void add(const B &buffer, std::string_view name, const labels &extra = {}) {
+        entry e { &buffer, {}, [&buffer] { return buffer.stats(); } };
+        append_label(e.labels, "buffer", name);
+        for (const auto &[key, value] : extra) {
+            check_name(key);
+            append_label(e.labels, key, value);
+        }
+        std::lock_guard lock { mutex };
+        entries.push_back(std::move(e));
+    }
+
+    /**
+     * @brief Unregister a buffer
+     */
+    void remove(const void *buffer) noexcept {
+        std::lock_guard lock { mutex };
+        std::erase_if(entries, [&](const entry &e) { return e.buffer == buffer; });
+    }
+
+    /**
+     * @brief Render the metrics of every registered buffer
+     * @return the metrics in the Prometheus text exposition format
+     */
+    std::string render() const {
+        std::vector<std::pair<std::string, buffer_stats>> snapshots;
+        {
+            std::lock_guard lock { mutex };
+            snapshots.reserve(entries.size());
+            for (const auto &e : entries)
+                snapshots.emplace_back(e.labels, e.stats());
+        }
+        auto sides = [](const buffer_stats &stats) {
+            return std::array<std::pair<const char *, const buffer_stats::manager *>, 2> { { { "write", &stats.write }, { "read", &stats.read } } };
+        };
+
+        std::string out;
+        for (const auto &c : counters) {
+            family(out, c.name, c.help, "counter");
+            for (const auto &[labels, stats] : snapshots)
+                for (auto [side, manager] : sides(stats))
+                    std::format_to(std::back_inserter(out), "{}_{}{{{},side=\"{}\"}} {}\n", prefix, c.name, labels, side, manager->*c.field);
+        }
+        family(out, "committed_bytes_total", "The number of bytes committed.", "counter");
+        for (const auto &[labels, stats] : snapshots)
+            std::format_to(std::back_inserter(out), "{}_committed_bytes_total{{{}}} {}\n", prefix, labels, stats.bytes_committed);
+        family(out, "consumed_bytes_total", "The number of bytes consumed.", "counter");
+        for (const auto &[labels, stats] : snapshots)
+            std::format_to(std::back_inserter(out), "{}_consumed_bytes_total{{{}}} {}\n", prefix, labels, stats.bytes_consumed);
+        family(out, "high_water_elements", "The largest committed size seen.", "gauge");
+        for (const auto &[labels, stats] : snapshots)
+            std::format_to(std::back_inserter(out), "{}_high_water_elements{{{}}} {}\n", prefix, labels, stats.high_water);
+
+        for (const auto &h : histograms) {
+            family(out, h.name, h.help, "histogram");
+            for (const auto &[labels, stats] : snapshots)
+                for (auto [side, manager] : sides(stats))
+                    samples(out, h.name, std::format("{},side=\"{}\"", labels, side), manager->*h.field, h.sum ? double(manager->*h.sum) : -1);
+        }
+        family(out, "queue_latency_seconds", "The time from committing each batch to consuming it.", "histogram");
+        for (const auto &[labels, stats] : snapshots)
+            samples(out, "queue_latency_seconds", labels, stats.queue_latency, -1);
+        return out;
+    }
+
+    /**
+     * @brief Render the metrics into a file, such as one read by the textfile collector of the node exporter
+     * @note The metrics are written to a temporary file that is renamed over `path`, so readers never see a partial file.
+     * @throw std::ios_base::failure or std::filesystem::filesystem_error if the file cannot be written
+     */
+    void write(const std::filesystem::path &path) const {
+        auto temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream file;
+            file.exceptions(std::ios::failbit | std::ios::badbit);
+            file.open(temporary, std::ios::binary | std::ios::trunc);
+            file << render();
+        }
+        std::filesystem::rename(temporary, path);
+    }
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <streambuf.hpp>
+#include <boost/asio/experimental/awaitable_operators.hpp>
+#include <algorithm>
+#include <concepts>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#define def constexpr auto
+
+/**
+ * @brief Coroutine stages connected by `StreamBuffer`s, such as `source<int>(f) | stage(g) | sink(h)`.
+ * @note Each hop is a `StreamBuffer` of the capacity chosen by the stage that writes it, so a slow stage
+ *       stops the stages before it once their buffers are full. Every stage moves whole views: a stage
+ *       reads all the data committed so far and writes its results into whatever space is free,
+ *       so it does not wait for the next stage to drain its buffer.
+ * @note A stage can run on its own executor with `on()`, so the stages of a pipeline run in parallel.
+ */
+namespace pipeline {
+
+    using executor = boost::asio::any_io_executor;
+
+    /**
+     * @brief Close a buffer when the stage that writes it returns or fails
+     */
+    template<class B>
+    struct closing {
+        B &buffer;
+        ~closing() { buffer.close(); }
+    };
+
+    /**
+     * @brief Run a loop on the executor of its stage, or on the current one
+     */
+    inline boost::asio::awaitable<void> launch(std::optional<executor> on, boost::asio::awaitable<void> loop) {
+        if (!on)
+            on = co_await boost::asio::this_coro::executor;
+        co_await boost::asio::co_spawn(*on, std::move(loop), boost::asio::use_awaitable);
+    }
+
+    /**
+     * @brief The executor a stage is placed on
+     */
+    struct placed {
+        std::optional<executor> where;
+
+        /**
+         * @brief Run this stage on another executor, such as one of a thread pool
+         */
+        def on(this auto self, executor e) { self.where = std::move(e); return self; }
+    };
+
+    /**
+     * @brief A stage that writes the stream
+     */
+    template<class P>
+    concept producer = requires { typename P::value_type; P::capacity; };
+
+    template<typename T, size_t N, class F>
+    struct source_stage : placed {
+        using value_type = T;
+        static constexpr size_t capacity = N;
+
+        F f;
+        size_t batch;
+
+        boost::asio::awaitable<void> start(StreamBuffer<T, N> &out) { return launch(where, produce(out)); }
+
+    private:
+        boost::asio::awaitable<void> produce(StreamBuffer<T, N> &out) {
+            closing guard { out };
+            while (true) {
+                auto view = co_await out.async_prepare(batch);
+                size_t n = std::invoke(f, view);
+                view.shrink(n);
+                if (n == 0)
+                    co_return;
+            }
+        }
+    };
+
+    template<size_t N, class F>
+    struct transform_stage : placed {
+        F f;
+    };
+
+    template<class F>
+    struct sink_stage : placed {
+        F f;
+    };
+
+    template<producer P, size_t N, class F>
+    struct transformed {
+        using input = StreamBuffer<typename P::value_type, P::capacity>;
+        using value_type = std::remove_cvref_t<std::invoke_result_t<F &, const typename P::value_type &>>;
+        static constexpr size_t capacity = N;
+
+        P upstream;
+        transform_stage<N, F> stage;
+
+        boost::asio::awaitable<void> start(StreamBuffer<value_type, N> &out) {
+            using namespace boost::asio::experimental::awaitable_operators;
+            input in;
+            co_await (upstream.start(in) && launch(stage.where, transform(in, out)));
+        }
+
+    private:
+        boost::asio::awaitable<void> transform(input &in, StreamBuffer<value_type, N> &out) {
+            closing guard { out };
+            while (true) {
+                auto batch = co_await in.async_read();
+                if (batch.empty())
+                    co_return;
+                for (auto first = batch.begin(); first != batch.end(); ) {
+                    // take whatever space is free, so this stage overlaps with the next one instead of waiting for it to drain
+                    auto view = co_await out.async_prepare();
+                    size_t n = std::min<size_t>(batch.end() - first, view.size());
+                    view.shrink(n);
+                    std::ranges::transform(first, first + n, view.begin(), std::ref(stage.f));
+                    first += n;
+                }
+            }
+        }
+    };
+
+    template<producer P, class F>
+    struct complete {
+        using input = StreamBuffer<typename P::value_type, P::capacity>;
+
+        P upstream;
+        sink_stage<F> stage;
+
+        /**
+         * @brief Run every stage until the source ends and the sink has consumed everything
+         * @note The pipeline must outlive the returned awaitable.
+         * @throw the first exception thrown by a stage, after the other stages are cancelled
+         */
+        boost::asio::awaitable<void> run() {
+            using namespace boost::asio::experimental::awaitable_operators;
+            input in;
+            co_await (upstream.start(in) && launch(stage.where, consume(in)));
+        }
+
+    private:
+        boost::asio::awaitable<void> consume(input &in) {
+            while (true) {
+                auto batch = co_await in.async_read();
+                if (batch.empty())
+                    co_return;
+                std::invoke(stage.f, batch);
+            }
+        }
+    };
+
+    /**
+     * @brief Create the first stage
+     * @param f called with a `write_view` of `batch` elements, returns how many it wrote, or 0 at the end of the stream
+     * @tparam T the element type
+     * @tparam N the capacity of the buffer to the next stage
+     */
+    template<typename T, size_t N = 1024, class F>
+    def source(F f, size_t batch = 64) -> source_stage<T, N, F> { return { {}, std::move(f), std::min(batch, N - 1) }; }
+
+    /**
+     * @brief Create a stage that maps each element
+     * @param f called with each element, returns the element to pass on
+     * @tparam N the capacity of the buffer to the next stage
+     */
+    template<size_t N = 1024, class F>
+    def stage(F f) -> transform_stage<N, F> { return { {}, std::move(f) }; }
+
+    /**
+     * @brief Create the last stage
+     * @param f called with each `read_view`, which is consumed when `f` returns
+     */
+    template<class F>
+    def sink(F f) -> sink_stage<F> { return { {}, std::move(f) }; }
+
+    template<producer P, size_t N, class F>
+    def operator|(P upstream, transform_stage<N, F> stage) -> transformed<P, N, F> { return { std::move(upstream), std::move(stage) }; }
+
+    template<producer P, class F>
+    def operator|(P upstream, sink_stage<F> stage) -> complete<P, F> { return { std::move(upstream), std::move(stage) }; }
+
+}
+
+#undef def
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <streambuf.hpp>
+#include <atomic>
+#include <array>
+#include <climits>
+#include <new>
+#include <utility>
+#include <system_error>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define def constexpr auto
+
+/**
+ * @brief A single-producer single-consumer FIFO buffer that can be shared between processes.
+ * @note The buffer holds no pointer and no process-local state, so it can be placed in shared memory
+ *       (see `shared_mapping`) and mapped at different addresses. The indices are lock-free atomics,
+ *       and blocking waits use a futex that is not private to the process.
+ * @note At most one view can be lent for writing and one for reading at a time.
+ * @tparam T the element type, which must be trivially copyable
+ * @tparam N the size of the storage, one element is reserved
+ */
+template<typename T, size_t N>
+class SharedStreamBuffer {
+
+    static_assert(N > 1, "SharedStreamBuffer size must be greater than 1");
+    static_assert(std::is_trivially_copyable_v<T>, "SharedStreamBuffer must have a trivially copyable value type");
+    static_assert(std::atomic<size_t>::is_always_lock_free, "SharedStreamBuffer requires lock-free atomics");
+
+    static def get_distance(size_t start, size_t end) noexcept { return end >= start ? end - start : N - (start - end); }
+
+    using signal = std::atomic<std::uint32_t>;
+
+    static void wait(signal &word, std::uint32_t expected) noexcept {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    static void wake(signal &word) noexcept {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    /**
+     * @brief Bump `word` and wake its waiters, skipping the system call if nobody waits
+     */
+    static void notify(signal &word, signal &waiting) noexcept {
+        word.fetch_add(1);
+        if (waiting.load() != 0)
+            wake(word);
+    }
+
+    /**
+     * @brief Block until `ready()` holds
+     */
+    static void wait_until(signal &word, signal &waiting, auto &&ready) noexcept {
+        while (!ready()) {
+            waiting.fetch_add(1);
+            std::uint32_t expected = word.load();
+            if (!ready())
+                wait(word, expected);
+            waiting.fetch_sub(1);
+        }
+    }
+
+    alignas(64) std::atomic<size_t> start = 0;      // the start of the committed data, written by the consumer
+    alignas(64) std::atomic<size_t> stop = 0;       // the end of the committed data, written by the producer
+    alignas(64) signal committed = 0;               // bumped after each commit
+    signal read_waiting = 0;                        // the number of consumers waiting on `committed`
+    alignas(64) signal consumed = 0;                // bumped after each consume
+    signal write_waiting = 0;                       // the number of producers waiting on `consumed`
+    alignas(64) std::atomic<bool> writing = false;  // whether a view is lent for writing
+    std::atomic<bool> reading = false;              // whether a view is lent for reading
+    T storage[N];
+
+    /**
+     * @brief A view that owns a part of the buffer.
+     * @note The view will automatically commit or consume its memory at destruction.
+     * @tparam Writing whether the view is lent for writing
+     */
+    template<bool Writing>
+    struct owning_view : view_interface<owning_view<Writing>> {
+        using iterator = typename StreamBuffer<T, N>::iterator;
+        def begin() const noexcept -> iterator { return { buffer->storage, first, first }; }
+        def end() const noexcept -> iterator { return { buffer->storage, first, last }; }
+
+        /**
+         * @brief Get the elements as contiguous parts
+         * @return the part before the end of the storage and the part after it, which may be empty
+         */
+        def segments() const noexcept -> std::array<std::span<T>, 2> {
+            if (first <= last)
+                return { std::span(buffer->storage + first, last - first), std::span<T>() };
+            return { std::span(buffer->storage + first, N - first), std::span(buffer->storage, last) };
+        }
+
+        owning_view(const owning_view &) = delete;
+        owning_view(owning_view &&other) noexcept : buffer { std::exchange(other.buffer, nullptr) }, first { other.first }, last { other.last } { }
+        owning_view &operator=(const owning_view &) = delete;
+        owning_view &operator=(owning_view &&other) noexcept {
+            std::swap(buffer, other.buffer);
+            std::swap(first, other.first);
+            std::swap(last, other.last);
+            return *this;
+        }
+        ~owning_view() {
+            if (buffer == nullptr) return;
+            if constexpr (Writing) {
+                buffer->stop.store(last, std::memory_order_release);
+                buffer->writing.store(false, std::memory_order_relaxed);
+                notify(buffer->committed, buffer->read_waiting);
+            } else {
+                buffer->start.store(last, std::memory_order_release);
+                buffer->reading.store(false, std::memory_order_relaxed);
+                notify(buffer->consumed, buffer->write_waiting);
+            }
+        }
+    private:
+        friend class SharedStreamBuffer;
+        owning_view(SharedStreamBuffer *buffer, size_t first, size_t n) noexcept : buffer { buffer }, first { first }, last { (first + n) % N } { }
+        SharedStreamBuffer *buffer;
+        size_t first;
+        size_t last;
+    };
+
+    /**
+     * @brief Mark a side as lent
+     * @throw std::logic_error if a view is already lent on this side
+     */
+    static void acquire(std::atomic<bool> &lent) {
+        if (lent.exchange(true, std::memory_order_acquire))
+            throw std::logic_error("SharedStreamBuffer allows one lent view per side");
+    }
+
+public:
+
+    using write_view = owning_view<true>;
+    using read_view = owning_view<false>;
+
+    SharedStreamBuffer() noexcept = default;
+    SharedStreamBuffer(const SharedStreamBuffer &) = delete;
+    SharedStreamBuffer &operator=(const SharedStreamBuffer &) = delete;
+
+    /**
+     * @brief Get the size of the committed data
+     */
+    def size() const noexcept { return get_distance(start.load(std::memory_order_acquire), stop.load(std::memory_order_acquire)); }
+
+    /**
+     * @brief Get the maximum size of the buffer
+     */
+    def max_size() const noexcept { return N - 1; }
+
+    /**
+     * @brief Check if the buffer is empty
+     */
+    def empty() const noexcept { return size() == 0; }
+
+    /**
+     * @brief Get the size of the space available for writing
+     */
+    def space() const noexcept { return N - 1 - size(); }
+
+    /**
+     * @brief Prepare a space for writing
+     * @param n the size to prepare
+     * @return a view for writing
+     * @throw std::out_of_range if not enough space is available
+     * @throw std::logic_error if a view is already lent for writing
+     */
+    def prepare(size_t n) -> write_view {
+        acquire(writing);
+        if (n > space()) {
+            writing.store(false, std::memory_order_relaxed);
+            throw std::out_of_range("borrow size too large");
+        }
+        return { this, stop.load(std::memory_order_relaxed), n };
+    }
+
+    /**
+     * @brief Read some data
+     * @param n the size to read
+     * @return a view for reading
+     * @throw std::out_of_range if not enough data is available
+     * @throw std::logic_error if a view is already lent for reading
+     */
+    def read(size_t n) -> read_view {
+        acquire(reading);
+        if (n > size()) {
+            reading.store(false, std::memory_order_relaxed);
+            throw std::out_of_range("borrow size too large");
+        }
+        return { this, start.load(std::memory_order_relaxed), n };
+    }
+
+    /**
+     * @brief Read all available data
+     * @return a view for reading, which is empty if no data is available
+     * @throw std::logic_error if a view is already lent for reading
+     */
+    def read() -> read_view {
+        acquire(reading);
+        return { this, start.load(std::memory_order_relaxed), size() };
+    }
+
+    /**
+     * @brief Prepare a space for writing, blocking until enough space is available
+     * @param n the size to prepare, at most `max_size()`
+     * @return a view for writing
+     */
+    def wait_prepare(size_t n) -> write_view {
+        if (n > max_size())
+            throw std::out_of_range("borrow size too large");
+        wait_until(consumed, write_waiting, [&] { return space() >= n; });
+        return prepare(n);
+    }
+
+    /**
+     * @brief Read some data, blocking until enough data is available
+     * @param n the size to read, at most `max_size()`
+     * @return a view for reading
+     */
+    def wait_read(size_t n) -> read_view {
+        if (n > max_size())
+            throw std::out_of_range("borrow size too large");
+        wait_until(committed, read_waiting, [&] { return size() >= n; });
+        return read(n);
+    }
+};
+
+/**
+ * @brief A buffer constructed in a POSIX shared memory object and mapped into this process.
+ * @note The mapping is released at destruction, while the shared memory object lives until `unlink()`.
+ * @tparam B the buffer type, usually a `SharedStreamBuffer`
+ */
+template<class B>
+class shared_mapping {
+    B *buffer;
+
+    explicit shared_mapping(const char *name, int flags) {
+        int fd = shm_open(name, flags, 0600);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), "shm_open");
+        if ((flags & O_CREAT) && ftruncate(fd, sizeof(B)) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::system_category(), "ftruncate");
+        }
+        void *memory = mmap(nullptr, sizeof(B), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        close(fd);
+        if (memory == MAP_FAILED)
+            throw std::system_error(error, std::system_category(), "mmap");
+        buffer = (flags & O_CREAT) ? new (memory) B() : static_cast<B *>(memory);
+    }
+
+public:
+    /**
+     * @brief Create a shared memory object and construct the buffer in it
+     * @param name the name of the object, such as "/frames"
+     * @throw std::system_error if the object already exists or cannot be mapped
+     */
+    static shared_mapping create(const char *name) { return shared_mapping(name, O_CREAT | O_EXCL | O_RDWR); }
+
+    /**
+     * @brief Map a buffer created by another process
+     * @param name the name of the object
+     * @throw std::system_error if the object does not exist or cannot be mapped
+     */
+    static shared_mapping open(const char *name) { return shared_mapping(name, O_RDWR); }
+
+    /**
+     * @brief Remove the shared memory object, the existing mappings stay valid
+     */
+    static void unlink(const char *name) noexcept { shm_unlink(name); }
+
+    shared_mapping(const shared_mapping &) = delete;
+    shared_mapping(shared_mapping &&other) noexcept : buffer { std::exchange(other.buffer, nullptr) } { }
+    shared_mapping &operator=(const shared_mapping &) = delete;
+    shared_mapping &operator=(shared_mapping &&other) noexcept { std::swap(buffer, other.buffer); return *this; }
+    ~shared_mapping() {
+        if (buffer != nullptr)
+            munmap(buffer, sizeof(B));
+    }
+
+    B &operator*() const noexcept { return *buffer; }
+    B *operator->() const noexcept { return buffer; }
+};
+
+#undef def
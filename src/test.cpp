@@ -1,11 +1,21 @@
 #include <streambuf.hpp>
+#include <streambuf_checksum.hpp>
+#include <streambuf_file.hpp>
+#include <streambuf_metrics.hpp>
+#include <streambuf_shared.hpp>
 
 #include <memory>
+#include <numeric>
 #include <vector>
 #include <span>
 #include <string>
 #include <iostream>
+#include <tuple>
+#include <sstream>
 #include <ranges>
+#include <filesystem>
+#include <format>
+#include <thread>
 
 template <typename T>
 consteval auto get_type_name() {
@@ -59,6 +69,28 @@ bool run(auto &&f) {
 }
 
 #include <cassert>
+// the log buckets: exact below 4, then 4 linear buckets per power of two
+static_assert(stat_histogram::bucket(0) == 0 && stat_histogram::bucket(3) == 3);
+static_assert(stat_histogram::bucket(4) == 4 && stat_histogram::bucket(7) == 7 && stat_histogram::bucket(8) == 8 && stat_histogram::bucket(9) == 8);
+static_assert(stat_histogram::bucket(std::uint64_t(1) << 63) == 248 && stat_histogram::lower_bound(248) == std::uint64_t(1) << 63);
+static_assert(stat_histogram::bucket(std::numeric_limits<std::uint64_t>::max()) == stat_histogram::bucket_count - 1);
+static_assert([] {
+    auto in_bucket = [](std::uint64_t v) {
+        size_t b = stat_histogram::bucket(v);
+        return stat_histogram::lower_bound(b) <= v && (b + 1 == stat_histogram::bucket_count || v < stat_histogram::lower_bound(b + 1));
+    };
+    for (size_t b = 0; b < stat_histogram::bucket_count; ++b)
+        if (stat_histogram::bucket(stat_histogram::lower_bound(b)) != b)
+            return false;
+    for (std::uint64_t v = 0; v < 4096; ++v)
+        if (!in_bucket(v))
+            return false;
+    for (size_t e = 2; e < 64; ++e)
+        if (!in_bucket((std::uint64_t(1) << e) - 1) || !in_bucket(std::uint64_t(1) << e) || !in_bucket((std::uint64_t(1) << e) + 1))
+            return false;
+    return true;
+}());
+
 int main() {
 
     StreamBuffer<int, 11> rb{};
@@ -92,5 +124,542 @@ int main() {
         auto v = rb.read(1);
     }) == false);
 
+    assert(run([&](){
+        auto v = rb.prepare(3);
+        for (int i = 0; i < 3; ++i)
+            v[i] = i;
+    }) == true);
+    {
+        auto copy = rb.snapshot();
+        assert(copy.size() == 3 && copy[2] == 2);
+        std::vector<int> out(rb.size());
+        assert(std::ranges::equal(rb.snapshot(out), std::vector { 0, 1, 2 }));
+        assert(segmented::equal(rb, out) && segmented::equal(rb, rb.snapshot()));
+        assert(segmented::find(rb, 2) == rb.begin() + 2 && segmented::find(rb, 7) == rb.end());
+        segmented::fill(rb, 5);
+        assert(segmented::count(rb, 5) == 3);
+        auto linear = rb.linearize();
+        assert(linear.size() == 3 && linear.data() == &rb.front() && linear[2] == 5);
+    }
+    assert(run([&](){
+        auto v = rb.prepare(7);
+        for (int i = 0; i < 7; ++i)
+            v[i] = i;
+    }) == true);
+    rb.read(8);
+    assert(run([&](){
+        auto v = rb.prepare(3);
+        for (int i = 0; i < 3; ++i)
+            v[i] = i + 7;
+    }) == true);
+    {
+        auto v = rb.read_contiguous(4);
+        std::span<int> s = v;
+        assert(std::ranges::equal(s, std::vector { 5, 6, 7, 8 }));
+    }
+    rb.clear();
+
+    {
+        StreamBuffer<int, 8> bb{};
+        auto logger = bb.subscribe();
+        assert(run([&](){
+            auto v = bb.prepare(6);
+            for (int i = 0; i < 6; ++i)
+                v[i] = i;
+        }) == true);
+        bb.read(6);
+        assert(bb.empty() && logger.size() == 6);
+        assert(run([&](){
+            auto v = bb.prepare(2);
+        }) == false);
+        bb.prepare(1);
+        assert(bb.full());
+        assert(run([&](){
+            auto v = logger.read(6);
+            for (int i = 0; i < 6; ++i)
+                assert(v[i] == i);
+        }) == true);
+        assert(run([&](){
+            auto v = bb.prepare(2);
+        }) == true);
+        assert(logger.size() == 3);
+    }
+
+    {
+        StreamBuffer<int, 4> tb{};
+        for (int i = 0; i < 5; ++i)
+            tb.prepare_overwrite(1)[0] = i;
+        assert(tb.size() == 3 && tb.front() == 2);
+        assert(tb.take_dropped() == 2 && tb.take_dropped() == 0);
+    }
+
+    StreamBuffer<std::byte, 32> mb{};
+
+    for (int round = 0; round < 4; ++round) {
+        assert(run([&](){
+            auto m = mb.prepare_message(5);
+            for (int i = 0; i < 5; ++i)
+                m[i] = std::byte(round * 10 + i);
+        }) == true);
+        assert(run([&](){
+            auto m = mb.read_message();
+            assert(m.size() == 5);
+            for (int i = 0; i < 5; ++i)
+                assert(m[i] == std::byte(round * 10 + i));
+        }) == true);
+    }
+    assert(mb.empty());
+    assert(run([&](){
+        auto m = mb.read_message();
+    }) == false);
+    assert(run([&](){
+        auto m = mb.prepare_message(32);
+    }) == false);
+    assert(run([&](){
+        mb.prepare_message(1)[0] = std::byte(1);
+        mb.prepare_message(2)[1] = std::byte(2);
+    }) == true);
+    {
+        auto batch = mb.read_messages(8);
+        assert(batch.size() == 2);
+        size_t total = 0;
+        for (auto payload : batch)
+            total += payload.size();
+        assert(total == 3);
+    }
+    assert(mb.empty());
+
+    StreamBuffer<std::unique_ptr<std::string>, 8, uninitialized_storage<std::unique_ptr<std::string>, 8>> ub{};
+
+    for (int round = 0; round < 3; ++round) {
+        assert(run([&](){
+            auto v = ub.prepare(5);
+            for (int i = 0; i < 5; ++i)
+                v.emplace(i, std::make_unique<std::string>(std::to_string(round + i)));
+        }) == true);
+        assert(run([&](){
+            auto v = ub.read(5);
+            for (int i = 0; i < 5; ++i)
+                assert(*v[i] == std::to_string(round + i));
+        }) == true);
+    }
+    assert(ub.empty());
+    assert(run([&](){
+        auto v = ub.prepare(2);
+        v.emplace(0, std::make_unique<std::string>("a"));
+        v.emplace(1, std::make_unique<std::string>("b"));
+    }) == true);
+    {
+        std::unique_ptr<std::string> p;
+        assert(ub.pop_into(p) && *p == "a");
+        std::vector<std::unique_ptr<std::string>> out;
+        ub.read().drain_into(std::back_inserter(out));
+        assert(out.size() == 1 && *out[0] == "b");
+        assert(!ub.pop_into(p));
+    }
+
+    {
+        struct fragile {
+            std::unique_ptr<int> value;
+            explicit fragile(int v) : value { v < 0 ? throw std::invalid_argument("negative") : std::make_unique<int>(v) } { }
+        };
+        StreamBuffer<fragile, 8, uninitialized_storage<fragile, 8>> fb{};
+        assert(run([&](){
+            auto v = fb.prepare(4);
+            v.emplace(0, 1);
+            v.emplace(1, 2);
+            v.emplace(2, -1);
+        }) == false);
+        assert(fb.size() == 2 && *fb.read(2)[1].value == 2);
+        fb.prepare(3);
+        assert(fb.empty());
+        {
+            auto first = fb.prepare(2);
+            first.emplace(0, 3);
+            bool refused = false;
+            try { fb.prepare(1); }
+            catch (std::logic_error &) { refused = true; }
+            assert(refused);
+        }
+        assert(fb.size() == 1 && *fb.read(1)[0].value == 3);
+    }
+
+    StreamBuffer<std::byte, 64, aligned_storage<std::byte, 64, 16>> ab{};
+    ab.prepare_aligned(1, 16);
+    assert(ab.read_aligned(64, 16).size() == 16);
+    for (int round = 0; round < 4; ++round) {
+        assert(run([&](){
+            auto v = ab.prepare_aligned(20, 16);
+            assert(v.size() == 32 && reinterpret_cast<std::uintptr_t>(v.data()) % 16 == 0);
+            v[0] = std::byte(round);
+        }) == true);
+        assert(run([&](){
+            auto v = ab.read_aligned(64, 16);
+            assert(v.size() == 32 && v[0] == std::byte(round));
+        }) == true);
+    }
+    assert(ab.empty());
+    {
+        StreamBuffer<std::byte, 64, aligned_storage<std::byte, 64, 16>> cb{};
+        cb.close();
+        bool refused = false;
+        try { cb.prepare_aligned(16, 16); }
+        catch (std::logic_error &) { refused = true; }
+        assert(refused && cb.empty());
+    }
+    {
+        StreamBuffer<std::byte, 64, aligned_storage<std::byte, 64, 16>> pb{};
+        pb.prepare_aligned(16, 16);
+        pb.read_aligned(64, 16);
+        pb.prepare_aligned(32, 16);
+        pb.read_aligned(64, 16);
+        pb.prepare_aligned(32, 16);   // pads the end of the storage
+        bool refused = false;
+        try { pb.linearize(); }
+        catch (std::logic_error &) { refused = true; }
+        assert(refused);
+    }
+    {
+        StreamBuffer<int, 8> eb{};
+        eb.prepare(5);
+        eb.read(5);
+        auto empty = eb.linearize();
+        eb.prepare(7);
+        assert(empty.empty() && eb.linearize().data() == empty.data());
+    }
+
+    {
+        auto path = (std::filesystem::temp_directory_path() / "streambuf_test.ring").string();
+        std::filesystem::remove(path);
+        {
+            StreamBuffer<int, 16, mapped_storage<int, 16>> pb(path.c_str());
+            for (int i = 0; i < 5; ++i)
+                pb.prepare(1)[0] = i;
+            pb.read(2);
+        }
+        StreamBuffer<int, 16, mapped_storage<int, 16>> pb(path.c_str());
+        assert(pb.size() == 3 && pb.front() == 2 && pb.back() == 4);
+        std::filesystem::remove(path);
+    }
+
+    {
+        using shared = shared_mapping<SharedStreamBuffer<int, 8>>;
+        auto name = std::format("/streambuf_test_{}", getpid());
+        shared::unlink(name.c_str());
+        auto producer = shared::create(name.c_str());
+        auto consumer = shared::open(name.c_str());
+        assert(&*producer != &*consumer && consumer->empty());
+        {
+            auto held = producer->prepare(0);
+            bool refused = false;
+            try { producer->prepare(0); }
+            catch (std::logic_error &) { refused = true; }
+            assert(refused);
+        }
+        std::thread writer([&] {
+            for (int i = 0; i < 100; i += 5) {
+                auto v = producer->wait_prepare(5);
+                for (int k = 0; k < 5; ++k)
+                    v[k] = i + k;
+            }
+        });
+        for (int i = 0; i < 100; i += 2) {
+            auto v = consumer->wait_read(2);
+            assert(v[0] == i && v[1] == i + 1);
+        }
+        writer.join();
+        assert(consumer->empty());
+        shared::unlink(name.c_str());
+    }
+
+    {
+        auto path = (std::filesystem::temp_directory_path() / "streambuf_test.sink").string();
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        assert(fd >= 0);
+        StreamBuffer<int, 8> sb {};
+        FileSink sink(sb, fd);
+        for (int i = 0; i < 20; i += 5) {
+            {
+                auto v = sb.prepare(5);
+                for (int k = 0; k < 5; ++k)
+                    v[k] = i + k;
+            }
+            sink.flush();
+        }
+        assert(sb.empty() && sink.position() == 20 * sizeof(int));
+        {
+            int rd = ::open(path.c_str(), O_RDONLY);
+            FileSink failing(sb, rd, sink.position());
+            sb.prepare(3);
+            bool failed = false;
+            try { failing.flush(); }   // fails at submission with pwritev, at completion with io_uring
+            catch (std::system_error &) { failed = true; }
+            assert(failed && failing.position() == 20 * sizeof(int) && sb.size() == 3);
+            ::close(rd);
+        }
+        sink.flush();
+        assert(sb.empty() && sink.position() == 23 * sizeof(int));
+        std::vector<int> written(sink.position() / sizeof(int));
+        assert(::pread(fd, written.data(), written.size() * sizeof(int), 0) == ssize_t(written.size() * sizeof(int)));
+        for (int i = 0; i < 20; ++i)
+            assert(written[i] == i);
+        ::close(fd);
+        std::filesystem::remove(path);
+    }
+
+    {
+        StreamBuffer<int, 8> kb {};
+        static_assert(!requires (decltype(kb)::read_view &v) { v.shrink(0); });
+        static_assert(!requires (decltype(kb)::subscriber::view &v) { v.shrink(0); } && !requires (decltype(kb)::subscriber::view &v) { v.emplace(0, 0); });
+        auto first = kb.prepare(3);
+        auto second = kb.prepare(3);
+        bool refused = false;
+        try { first.shrink(1); }
+        catch (std::logic_error &) { refused = true; }
+        assert(refused && first.size() == 3);
+        second.shrink(1);
+        assert(second.size() == 1 && kb.space() == 3);
+    }
+
+    {
+        StreamBuffer<int, 8> ob {};
+        assert(!ob.oldest_read_view() && !ob.oldest_write_view());
+        ob.prepare(4);
+        ob.read(1);
+        {
+            auto older = ob.read(1);
+            auto held = ob.prepare(2);
+            assert(ob.oldest_write_view()->position == 4);
+            {
+                auto newer = ob.read(2);
+                assert(ob.oldest_read_view()->position == 1);
+            }
+            assert(ob.oldest_read_view()->position == 1);
+        }
+        assert(!ob.oldest_read_view() && !ob.oldest_write_view());
+    }
+
+    {
+        auto path = (std::filesystem::temp_directory_path() / "streambuf_test.source").string();
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        std::vector<int> data(10);
+        std::iota(data.begin(), data.end(), 0);
+        assert(::pwrite(fd, data.data(), data.size() * sizeof(int), 0) == ssize_t(data.size() * sizeof(int)));
+        StreamBuffer<int, 32> fb {};
+        FileSource source(fb, fd, 0, 4, 4);
+        size_t total = 0;
+        assert(!fb.closed());
+        while (!source.eof())
+            total += source.fill();
+        assert(total == 10 && fb.size() == 10 && source.in_flight() == 0 && fb.closed());
+        auto v = fb.read();
+        assert(std::ranges::equal(v, data));
+        ::close(fd);
+        std::filesystem::remove(path);
+    }
+
+    {
+        int fds[2];
+        assert(::pipe(fds) == 0);
+        std::vector<int> data(10);
+        std::iota(data.begin(), data.end(), 100);
+        assert(::write(fds[1], data.data(), data.size() * sizeof(int)) == ssize_t(data.size() * sizeof(int)));
+        ::close(fds[1]);
+        StreamBuffer<int, 8> pb {};
+        FileSource source(pb, fds[0], -1, 4);
+        std::vector<int> received;
+        while (!source.eof()) {
+            source.fill();
+            for (int x : pb.read())
+                received.push_back(x);
+        }
+        assert(received == data && pb.closed());
+        ::close(fds[0]);
+    }
+
+    {
+        int fds[2];
+        assert(::pipe(fds) == 0);
+        StreamBuffer<int, 8> xb {};
+        FileSource source(xb, fds[1], -1, 4);   // reading the write end fails
+        bool failed = false;
+        try { source.fill(); }
+        catch (std::system_error &) { failed = true; }
+        assert(failed && source.eof() && xb.empty() && xb.closed());
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    {
+        auto path = (std::filesystem::temp_directory_path() / "streambuf_test.spill").string();
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        SpillBuffer<StreamBuffer<int, 8>> sp(fd);
+        auto write = [&](int first, int last) {
+            for (int i = first; i < last; ++i)
+                sp.prepare(1)[0] = i;
+        };
+        auto drain = [&](int first, size_t max = std::numeric_limits<size_t>::max()) {
+            auto v = sp.read(max);
+            for (size_t i = 0; i < v.size(); ++i)
+                assert(v[i] == first + int(i));
+            return first + int(v.size());
+        };
+        write(0, 5);
+        assert(sp.memory_size() == 5 && sp.spilled_size() == 0);
+        write(5, 20);   // spills 0..6 and 7..13
+        assert(sp.memory_size() == 6 && sp.spilled_size() == 14);
+        int next = drain(0, 3);   // reloads 0..6
+        assert(next == 3 && sp.memory_size() == 6 && sp.spilled_size() == 11);
+        next = drain(next);
+        assert(next == 7 && sp.spilled_size() == 7);
+        next = drain(next);   // reloads 7..13 and drains the file
+        assert(next == 14 && sp.memory_size() == 6 && sp.spilled_size() == 0);
+        write(20, 22);  // spills 14..20 from the beginning of the file
+        assert(sp.memory_size() == 1 && sp.spilled_size() == 7);
+        assert(std::filesystem::file_size(path) == 14 * sizeof(int));
+        while (!sp.empty())
+            next = drain(next);
+        assert(next == 22 && sp.memory_size() == 0 && sp.spilled_size() == 0);
+        ::close(fd);
+        std::filesystem::remove(path);
+    }
+
+    {
+        stat_histogram::counts counts;
+        for (std::uint64_t v = 1; v <= 100; ++v)
+            ++counts.buckets[stat_histogram::bucket(v)];
+        assert(counts.total() == 100);
+        assert(counts.quantile(0) == 1 && counts.quantile(0.5) == 48 && counts.quantile(0.99) == 96);
+        assert(counts.quantile(1.0) == 96 && stat_histogram::counts {}.quantile(1.0) == 0);
+    }
+
+#if defined(STREAMBUF_ENABLE_STATS)
+    {
+        StreamBuffer<int, 64> lb {};
+        std::thread writer([&] {
+            for (int i = 0; i < 10000;)
+                try {
+                    lb.prepare(1)[0] = i;
+                    ++i;
+                } catch (std::out_of_range &) { }
+        });
+        for (size_t n = 0; n < 10000;)
+            n += lb.read().size();
+        writer.join();
+        auto stats = lb.stats();
+        for (const auto &side : { stats.write, stats.read }) {
+            assert(side.acquisitions >= side.lends + side.returns + side.failures);
+            assert(side.lock_hold.total() == side.acquisitions);
+            assert(side.contended <= side.acquisitions && side.lock_wait.total() == side.contended);
+            assert(side.lock_hold_ns > 0);
+        }
+        assert(stats.write.lends == 10000 && stats.write.elements == 10000 && stats.read.elements == 10000);
+    }
+
+    {
+        auto stats = ab.stats();
+        assert(stats.write.lends == 5 && stats.read.lends == 5);
+        assert(stats.write.lends == stats.write.returns && stats.bytes_committed == stats.bytes_consumed);
+        assert(stats.high_water == 48);
+    }
+
+    {
+        using namespace std::chrono_literals;
+        StreamBuffer<int, 8> qb {};
+        qb.prepare(2);
+        std::this_thread::sleep_for(5ms);
+        qb.read(2);
+        auto latency = qb.stats().queue_latency;
+        // the histogram and its conversion to nanoseconds each round down by less than 25%
+        assert(latency.total() == 1 && latency.quantile(0) >= 2'000'000);
+
+        qb.prepare(4);
+        qb.prepare(3);
+        qb.prepare_overwrite(4);    // drops the first batch, which is never read
+        assert(qb.take_dropped() == 4);
+        qb.read();
+        assert(qb.stats().queue_latency.total() == 3);
+    }
+#endif
+
+#if defined(STREAMBUF_ENABLE_TRACE)
+    {
+        StreamBuffer<int, 8> tb {};
+        tb.prepare(3);
+        tb.read(2);
+        try { tb.read(5); }
+        catch (std::out_of_range &) { }
+        using op = trace_op;
+        const std::vector<std::tuple<trace_op, std::uint64_t, std::uint64_t>> expected {
+            { op::prepare, 0, 3 }, { op::commit, 0, 3 }, { op::read, 0, 2 }, { op::consume, 0, 2 }, { op::fail, 2, 5 },
+        };
+        auto events = tb.trace();
+        assert(events.size() == expected.size());
+        for (size_t i = 0; i < events.size(); ++i)
+            assert(std::tuple(events[i].op, events[i].position, events[i].size) == expected[i]);
+        assert(std::ranges::is_sorted(events, {}, &trace_event::timestamp));
+
+        int fds[2];
+        assert(::pipe(fds) == 0);
+        tb.write_trace(fds[1]);
+        ::close(fds[1]);
+        std::string text;
+        char chunk[256];
+        for (ssize_t n; (n = ::read(fds[0], chunk, sizeof(chunk))) > 0;)
+            text.append(chunk, n);
+        ::close(fds[0]);
+        std::istringstream lines(text);
+        const std::vector<std::string> names { "prepare", "commit", "read", "consume", "fail" };
+        size_t i = 0;
+        for (std::string line; std::getline(lines, line); ++i) {
+            std::istringstream fields(line);
+            std::uint64_t timestamp, thread, position, size;
+            std::string name;
+            assert(fields >> timestamp >> thread >> name >> position >> size && (fields >> std::ws).eof());
+            assert(i < events.size() && timestamp == events[i].timestamp && thread == events[i].thread);
+            assert(name == names[i] && position == events[i].position && size == events[i].size);
+        }
+        assert(i == events.size());
+    }
+#endif
+
+    StreamBuffer<char, 12> cb{};
+    cb.prepare(6);
+    cb.read(6);
+    checksum::crc32c_state committed;
+    {
+        checksum::checksummed v { cb.prepare(9), committed };
+        std::ranges::copy(std::string_view("123456789"), v.begin());
+    }
+    assert(checksum::crc32c(cb) == 0xE3069283 && committed.value() == 0xE3069283);
+    assert(checksum::hash(cb) == checksum::hash(std::string_view("123456789")));
+
+    MetricsRegistry metrics;
+    metrics.add(cb, "checksummed", { { "stage", "test" } });
+    assert(metrics.render().contains("streambuf_lends_total{buffer=\"checksummed\",stage=\"test\",side=\"write\"}"));
+    metrics.remove(&cb);
+
+    {
+        StreamBuffer<int, 8> sb {};
+        MetricsRegistry registry;
+        registry.add(sb, "scraped");
+        auto buckets = [&] {
+            std::vector<std::string> labels;
+            std::istringstream lines(registry.render());
+            for (std::string line; std::getline(lines, line);)
+                if (line.contains("_bucket{"))
+                    labels.push_back(line.substr(0, line.rfind(' ')));
+            return labels;
+        };
+        auto before = buckets();
+        sb.prepare(3);
+        sb.read(3);
+        assert(buckets() == before);
+        auto first = "streambuf_queue_latency_seconds_bucket{buffer=\"scraped\",le=\"1e-09\"}";
+        auto last = "streambuf_queue_latency_seconds_bucket{buffer=\"scraped\",le=\"+Inf\"}";
+        auto from = std::ranges::find(before, first), to = std::ranges::find(before, last);
+        assert(from != before.end() && to != before.end() && to - from == 64);
+    }
+
     return 0;
 }
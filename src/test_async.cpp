@@ -1,6 +1,9 @@
 #include <iostream>
 #include <streambuf.hpp>
+#include <streambuf_pipeline.hpp>
 #include <boost/asio/experimental/awaitable_operators.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <vector>
 
 using boost::asio::awaitable;
 using namespace boost::asio::experimental::awaitable_operators;
@@ -74,5 +77,103 @@ awaitable<void> async_main() {
     print(rb.read());
     assert(rb.empty());
 
+    int produced = 0;
+    long total = 0;
+    co_await (pipeline::source<int, 8>([&](auto &view) {
+            size_t n = std::min<size_t>(view.size(), 100 - produced);
+            for (size_t i = 0; i < n; ++i)
+                view[i] = produced++;
+            return n;
+        })
+        | pipeline::stage([](int x) { return x * 2L; })
+        | pipeline::sink([&](auto &batch) { for (long x : batch) total += x; })).run();
+    assert(total == 9900);
+
+    {
+        boost::asio::thread_pool pool(2);
+        std::vector<long> results;
+        produced = 0;
+        co_await (pipeline::source<int, 8>([&](auto &view) {
+                size_t n = std::min<size_t>(view.size(), 100 - produced);
+                for (size_t i = 0; i < n; ++i)
+                    view[i] = produced++;
+                return n;
+            })
+            | pipeline::stage<4>([](int x) { return x * 3L; }).on(pool.get_executor())
+            | pipeline::sink([&](auto &batch) { for (long x : batch) results.push_back(x); })).run();
+        assert(results.size() == 100);
+        for (size_t i = 0; i < results.size(); ++i)
+            assert(results[i] == 3 * long(i));
+    }
+
+    StreamBuffer<int, 8> fb {};
+    fb.prepare(7);
+    co_await ([&]() -> awaitable<void> {
+        auto view = co_await fb.async_prepare();   // waits for any space, not for an empty buffer
+        assert(view.size() == 2);
+    }() && [&]() -> awaitable<void> {
+        co_await sleep(1ms);
+        fb.read(2);
+    }());
+
+    StreamBuffer<int, 8> eb {};
+    eb.prepare(3);
+    eb.close();
+    {
+        auto rest = co_await eb.async_read(5);
+        auto end = co_await eb.async_read(5);
+        assert(rest.size() == 3 && end.empty());
+    }
+    co_await eb.async_drain();
+    bool refused = false;
+    try { co_await eb.async_prepare(1); }
+    catch (std::logic_error &) { refused = true; }
+    assert(refused);
+
+    StreamBuffer<int, 16> nb {};
+    nb.enable_eventfd(4, 4);
+    int sent = 0, received = 0;
+    co_await (
+        [&]() -> awaitable<void> {
+            while (sent < 1000) {
+                {
+                    auto view = co_await nb.async_prepare(std::min(sent % 3 + 1, 1000 - sent));
+                    for (size_t i = 0; i < view.size(); ++i)
+                        view[i] = sent++;
+                }
+                co_await sleep(0ms);
+            }
+        }() &&
+        [&]() -> awaitable<void> {
+            while (received < 1000) {
+                auto view = co_await nb.async_read(5);
+                for (int x : view) {
+                    assert(x == received);
+                    ++received;
+                }
+            }
+        }()
+    );
+    assert(received == 1000 && nb.empty());
+
+    StreamBuffer<int, 8> db {};
+    db.enable_eventfd(1, 7);
+    db.prepare(3);
+    {
+        auto pending = db.prepare(2);   // keeps the space below the threshold
+        co_await (db.async_drain() && [&]() -> awaitable<void> {
+            for (int i = 0; i < 3; ++i) {
+                co_await sleep(1ms);
+                db.read(1);
+            }
+        }());
+    }
+    assert(db.size() == 2 && !db.drained());
+    co_await (db.async_drain() && [&]() -> awaitable<void> {
+        co_await sleep(1ms);
+        db.clear();
+    }());
+    assert(db.empty());
+
     co_return;
 }